@@ -71,11 +71,12 @@ int main(int argc, char** argv) {
         node_inequality_bounds,
         segment_inequality_bounds);
 
-  // Print some output info
+  // Print some output info. The summary holds however the problem was
+  // solved; the OSQP workspace may be null.
   // Reference: https://osqp.org/docs/interfaces/cc++#info
-  std::cout << "Status:                    " << solution.workspace->info->status << std::endl;
-  std::cout << "Status Val (1 == success): " << solution.workspace->info->status_val << std::endl;
-  std::cout << "Optimal Cost:              " << solution.workspace->info->obj_val << std::endl;
+  std::cout << "Solved:                    " << (SolveStatus::SOLVED == solution.status) << std::endl;
+  std::cout << "Status Val (1 == success): " << solution.osqp_status << std::endl;
+  std::cout << "Optimal Cost:              " << solution.objective << std::endl;
 
   // Sampling and Plotting
   { // Plot acceleration profiles
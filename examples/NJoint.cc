@@ -45,23 +45,26 @@ int main(int argc, char** argv) {
     // NodeInequalityBound(2,2,0,0.5,NodeInequalityBound::INFTY),
   };
 
-  // SegmentInequalityBound(segment_idx, derivative_idx, mapping, value)
-  // Segment inequality bounds constrain a derivative of a segment to 
-  //   dot(a,x) < b
-  const std::vector<SegmentInequalityBound> segment_inequality_bounds = {
-    // Constraining the x-acceleration of the first segment below 4 m/s^2
-    SegmentInequalityBound(0,1,Eigen::Vector2d(1,0),2),
-    SegmentInequalityBound(0,1,Eigen::Vector2d(0,1),2),
-    SegmentInequalityBound(1,1,Eigen::Vector2d(1,0),2),
-    SegmentInequalityBound(1,1,Eigen::Vector2d(0,1),2),
-    SegmentInequalityBound(0,2,Eigen::Vector2d(1,0),4),
-    SegmentInequalityBound(0,2,Eigen::Vector2d(0,1),4),
-    SegmentInequalityBound(1,2,Eigen::Vector2d(1,0),4),
-    SegmentInequalityBound(1,2,Eigen::Vector2d(0,1),4),
-    SegmentInequalityBound(0,3,Eigen::Vector2d(1,0),10),
-    SegmentInequalityBound(0,3,Eigen::Vector2d(0,1),10),
-    SegmentInequalityBound(1,3,Eigen::Vector2d(1,0),10),
-    SegmentInequalityBound(1,3,Eigen::Vector2d(0,1),10),
+  // SegmentBoxBound(dimension_idx, segment_idx, derivative_idx, lower, upper)
+  // Segment box bounds constrain a derivative of a single joint over a
+  // segment to 
+  //   lower < x < upper
+  const std::vector<SegmentBoxBound> segment_box_bounds = {
+    // Limiting the velocity of both joints to +-2 rad/s
+    SegmentBoxBound(0,0,1,-2,2),
+    SegmentBoxBound(1,0,1,-2,2),
+    SegmentBoxBound(0,1,1,-2,2),
+    SegmentBoxBound(1,1,1,-2,2),
+    // Limiting the acceleration of both joints to +-4 rad/s^2
+    SegmentBoxBound(0,0,2,-4,4),
+    SegmentBoxBound(1,0,2,-4,4),
+    SegmentBoxBound(0,1,2,-4,4),
+    SegmentBoxBound(1,1,2,-4,4),
+    // Limiting the jerk of both joints to +-10 rad/s^3
+    SegmentBoxBound(0,0,3,-10,10),
+    SegmentBoxBound(1,0,3,-10,10),
+    SegmentBoxBound(0,1,3,-10,10),
+    SegmentBoxBound(1,1,3,-10,10),
   };
 
   // Configure solver options
@@ -83,13 +86,15 @@ int main(int argc, char** argv) {
         times, 
         node_equality_bounds,
         node_inequality_bounds,
-        segment_inequality_bounds);
+        {},
+        segment_box_bounds);
 
-  // Print some output info
+  // Print some output info. The summary holds however the problem was
+  // solved; the OSQP workspace may be null.
   // Reference: https://osqp.org/docs/interfaces/cc++#info
-  std::cout << "Status:                    " << solution.workspace->info->status << std::endl;
-  std::cout << "Status Val (1 == success): " << solution.workspace->info->status_val << std::endl;
-  std::cout << "Optimal Cost:              " << solution.workspace->info->obj_val << std::endl;
+  std::cout << "Solved:                    " << (SolveStatus::SOLVED == solution.status) << std::endl;
+  std::cout << "Status Val (1 == success): " << solution.osqp_status << std::endl;
+  std::cout << "Optimal Cost:              " << solution.objective << std::endl;
 
   // Sampling and Plotting
   { // Plot jerk profiles
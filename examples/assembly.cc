@@ -0,0 +1,72 @@
+// Author: Tucker Haydon
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+
+#include <Eigen/Dense>
+
+#include "polynomial_solver.h"
+
+using namespace p4;
+
+// Benchmarks the time spent assembling the QP as a function of the number of
+// nodes. The problem mirrors the speed example: a 1D trajectory with a pinned
+// initial state and a position constraint at every node. Assembly time is the
+// wall-clock time of PolynomialSolver::Run less the setup and solve times
+// reported by OSQP.
+//
+// Usage: assembly [num_threads]
+int main(int argc, char** argv) {
+  PolynomialSolver::Options solver_options;
+  solver_options.num_dimensions = 1;
+  solver_options.polynomial_order = 7;
+  solver_options.continuity_order = 4;
+  solver_options.derivative_order = 4;
+  solver_options.num_threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1;
+
+  solver_options.osqp_settings.polish = false;     // Only the assembly is of interest
+  solver_options.osqp_settings.verbose = false;    // Suppress the printout
+  solver_options.osqp_settings.max_iter = 1;       // Only the assembly is of interest
+  solver_options.direct_equality_solve = false;    // Time OSQP setup, which the direct solve skips
+
+  std::cout 
+    << std::setw(10) << "nodes" 
+    << std::setw(16) << "assembly [ms]" 
+    << std::setw(16) << "osqp setup [ms]" 
+    << std::endl;
+
+  for(size_t num_nodes = 1000; num_nodes <= 256000; num_nodes *= 2) {
+    std::vector<double> times = {0};
+    std::vector<NodeEqualityBound> equality_bounds = {
+      NodeEqualityBound(0,0,0,0),
+      NodeEqualityBound(0,0,1,0),
+      NodeEqualityBound(0,0,2,0),
+    };
+
+    for(size_t node_idx = 1; node_idx < num_nodes; ++node_idx) {
+      times.push_back(node_idx);
+      equality_bounds.push_back(NodeEqualityBound(0,node_idx,0,node_idx));
+    }
+
+    PolynomialSolver solver(solver_options);
+
+    const auto start = std::chrono::steady_clock::now();
+    const PolynomialSolver::Solution solution
+      = solver.Run(times, equality_bounds,{},{});
+    const auto stop = std::chrono::steady_clock::now();
+
+    const double run_time = std::chrono::duration<double>(stop - start).count();
+    const double setup_time = solution.workspace->info->setup_time;
+    const double solve_time = solution.workspace->info->solve_time;
+
+    std::cout 
+      << std::setw(10) << num_nodes 
+      << std::setw(16) << 1e3 * (run_time - setup_time - solve_time)
+      << std::setw(16) << 1e3 * setup_time
+      << std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
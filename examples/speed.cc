@@ -25,12 +25,23 @@ int main(int argc, char** argv) {
     NodeEqualityBound(0,0,2,0),
   };
 
+  // The positions of the remaining nodes are pinned by a single bound
+  // holding a row of waypoints, rather than one bound per node
+  Eigen::MatrixXd positions(1, num_nodes - 1);
   for(size_t node_idx = 1; node_idx < num_nodes; ++node_idx) {
     times.push_back(node_idx);
-
-    equality_bounds.push_back(NodeEqualityBound(0,node_idx,0,node_idx));
+    positions(0, node_idx - 1) = node_idx;
   }
 
+  // Values bounds paramater order is:
+  // 1) First dimension index
+  // 2) First node index
+  // 3) Derivative index
+  // 4) Values, one row per dimension and one column per node
+  const std::vector<NodeValuesBound> values_bounds = {
+    NodeValuesBound(0,1,0,positions)
+  };
+
   PolynomialSolver::Options solver_options;
   solver_options.num_dimensions = 1;
   solver_options.polynomial_order = 7;
@@ -42,7 +53,7 @@ int main(int argc, char** argv) {
 
   PolynomialSolver solver(solver_options);
   const PolynomialSolver::Solution solution
-    = solver.Run(times, equality_bounds,{},{});
+    = solver.Run(times, equality_bounds, {}, {}, {}, {}, {}, values_bounds);
 
   return EXIT_SUCCESS;
 }
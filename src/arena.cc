@@ -0,0 +1,74 @@
+// Author: Tucker Haydon
+
+#include <algorithm>
+#include <iostream>
+
+#include "arena.h"
+
+namespace p4 {
+  namespace {
+    // Blocks are never smaller than this
+    constexpr size_t kMinBlockSize = 64 * 1024;
+
+    char* SystemAllocate(const size_t num_bytes) {
+      char* data = static_cast<char*>(std::malloc(num_bytes));
+      if(nullptr == data) {
+        std::cerr << "Arena -- Failed to allocate " << num_bytes << " bytes." << std::endl;
+        std::exit(EXIT_FAILURE);
+      }
+      return data;
+    }
+  }
+
+  Arena::~Arena() {
+    this->Release();
+  }
+
+  void* Arena::AllocateBytes(const size_t num_bytes, const size_t alignment) {
+    if(false == this->blocks_.empty()) {
+      Block& block = this->blocks_.back();
+      const size_t aligned_offset 
+        = (this->block_offset_ + alignment - 1) / alignment * alignment;
+      if(aligned_offset + num_bytes <= block.size) {
+        this->block_offset_ = aligned_offset + num_bytes;
+        return block.data + aligned_offset;
+      }
+    }
+
+    // Grow geometrically. Malloc'd memory is aligned for any fundamental
+    // type, so a fresh block needs no padding.
+    size_t block_size = std::max(kMinBlockSize, num_bytes);
+    if(false == this->blocks_.empty()) {
+      block_size = std::max(block_size, 2 * this->blocks_.back().size);
+    }
+
+    this->blocks_.push_back(Block{SystemAllocate(block_size), block_size});
+    this->block_offset_ = num_bytes;
+    return this->blocks_.back().data;
+  }
+
+  void Arena::Reset() {
+    if(this->blocks_.size() > 1) {
+      const size_t capacity = this->Capacity();
+      this->Release();
+      this->blocks_.push_back(Block{SystemAllocate(capacity), capacity});
+    }
+    this->block_offset_ = 0;
+  }
+
+  void Arena::Release() {
+    for(const Block& block: this->blocks_) {
+      std::free(block.data);
+    }
+    this->blocks_.clear();
+    this->block_offset_ = 0;
+  }
+
+  size_t Arena::Capacity() const {
+    size_t capacity = 0;
+    for(const Block& block: this->blocks_) {
+      capacity += block.size;
+    }
+    return capacity;
+  }
+}
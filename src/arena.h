@@ -0,0 +1,55 @@
+// Author: Tucker Haydon
+
+#pragma once
+
+#include <cstdlib>
+#include <vector>
+
+namespace p4 {
+  // Monotonic memory arena. Allocations bump a pointer through a list of
+  // blocks and are never freed individually. Reset() releases every
+  // allocation at once but keeps the memory: if more than one block was
+  // needed since the last reset, the blocks are coalesced into a single block
+  // large enough to hold all of them. A workload that repeats with the same
+  // size is then served without touching the system allocator.
+  //
+  // Memory returned by the arena is uninitialized. Only trivially
+  // destructible types may be allocated; destructors are never run.
+  class Arena {
+    public:
+      Arena() {}
+      ~Arena();
+
+      // Copies do not share memory. A copied arena starts empty.
+      Arena(const Arena& /*other*/) {}
+      Arena& operator=(const Arena& /*other*/) { return *this; }
+
+      // Allocates uninitialized storage for count objects of type T
+      template <class T>
+      T* Allocate(const size_t count) {
+        return static_cast<T*>(this->AllocateBytes(count * sizeof(T), alignof(T)));
+      }
+
+      // Releases all allocations. Retains, and if necessary coalesces, the
+      // underlying memory.
+      void Reset();
+
+      // Returns the underlying memory to the system.
+      void Release();
+
+      // Total number of bytes held by the arena
+      size_t Capacity() const;
+
+    private:
+      struct Block {
+        char* data;
+        size_t size;
+      };
+
+      void* AllocateBytes(const size_t num_bytes, const size_t alignment);
+
+      std::vector<Block> blocks_;
+      // Number of bytes used in the last block
+      size_t block_offset_ = 0;
+  };
+}
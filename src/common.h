@@ -6,9 +6,39 @@
 #include <cstdlib>
 
 namespace p4 {
+  // Largest supported polynomial order. 21! overflows size_t, and 1/20! is
+  // already below double precision relative to the leading coefficient.
+  constexpr size_t kMaxPolynomialOrder = 20;
+
+  // Computes 1/n! at compile time
+  constexpr double ConstexprInverseFactorial(const size_t n) {
+    return 0 == n ? 1.0 : ConstexprInverseFactorial(n - 1) / n;
+  }
+
+  // Table of 1/n! for n in [0, kMaxPolynomialOrder]
+  constexpr double kInverseFactorials[kMaxPolynomialOrder + 1] = {
+    ConstexprInverseFactorial(0),  ConstexprInverseFactorial(1),
+    ConstexprInverseFactorial(2),  ConstexprInverseFactorial(3),
+    ConstexprInverseFactorial(4),  ConstexprInverseFactorial(5),
+    ConstexprInverseFactorial(6),  ConstexprInverseFactorial(7),
+    ConstexprInverseFactorial(8),  ConstexprInverseFactorial(9),
+    ConstexprInverseFactorial(10), ConstexprInverseFactorial(11),
+    ConstexprInverseFactorial(12), ConstexprInverseFactorial(13),
+    ConstexprInverseFactorial(14), ConstexprInverseFactorial(15),
+    ConstexprInverseFactorial(16), ConstexprInverseFactorial(17),
+    ConstexprInverseFactorial(18), ConstexprInverseFactorial(19),
+    ConstexprInverseFactorial(20),
+  };
+
   // Computes n!
   size_t Factorial(size_t n);
 
+  // Returns 1/n! from the compile-time table. n must not exceed
+  // kMaxPolynomialOrder.
+  inline double InverseFactorial(const size_t n) {
+    return kInverseFactorials[n];
+  }
+
   // Constructs and takes the derivative of a vector of the form:
   //   [ (1/0! dt^0), (1/1! dt^1), (1/2! dt^2) ... ]'
   // The derivative can be efficiently easily calculated by prepadding zeros
@@ -20,4 +50,33 @@ namespace p4 {
       const size_t polynomial_order, 
       const size_t derivative_order, 
       const double time);
+
+  // Non-allocating form of TimeVector. Writes the vector into a
+  // caller-provided buffer of polynomial_order + 1 elements.
+  void TimeVector(
+      const size_t polynomial_order, 
+      const size_t derivative_order, 
+      const double time,
+      double* coefficients);
+
+  // Fixed-size form of TimeVector for a compile-time polynomial order. The
+  // loop bound is a compile-time constant and is unrolled by the compiler.
+  template <size_t PolynomialOrder>
+  Eigen::Matrix<double, PolynomialOrder + 1, 1> TimeVectorT(
+      const size_t derivative_order, 
+      const double time) {
+    static_assert(PolynomialOrder <= kMaxPolynomialOrder, "Polynomial order exceeds kMaxPolynomialOrder.");
+
+    Eigen::Matrix<double, PolynomialOrder + 1, 1> coefficients;
+    double time_power = 1.0;
+    for(size_t idx = 0; idx < PolynomialOrder + 1; ++idx) {
+      if(idx < derivative_order) {
+        coefficients(idx) = 0;
+      } else {
+        coefficients(idx) = time_power * InverseFactorial(idx - derivative_order);
+        time_power *= time;
+      }
+    }
+    return coefficients;
+  }
 }
@@ -0,0 +1,373 @@
+// Author: Tucker Haydon
+
+#include <algorithm>
+#include <cmath>
+
+#include "direct_solver.h"
+
+namespace p4 {
+  namespace {
+    // Pivots at or below this fraction of the largest entry of the KKT
+    // system are treated as zero
+    constexpr double kPivotTolerance = 1e-13;
+
+    // Largest absolute entry of a vector
+    double MaxAbs(
+        const c_float* values,
+        const c_int count) {
+      double max_abs = 0;
+      for(c_int idx = 0; idx < count; ++idx) {
+        max_abs = std::max(max_abs, std::abs(values[idx]));
+      }
+      return max_abs;
+    }
+
+    // Adjacency of the unknowns of the KKT system. The unknowns are the n
+    // variables followed by the m multipliers.
+    struct Graph {
+      c_int num_nodes;
+      // Neighbours of node i are neighbours[offsets[i], offsets[i + 1])
+      c_int* offsets;
+      c_int* neighbours;
+    };
+
+    Graph MakeGraph(
+        const OSQPData& data,
+        Arena& arena) {
+      const csc* P = data.P;
+      const csc* A = data.A;
+      const c_int n = data.n;
+
+      Graph graph;
+      graph.num_nodes = data.n + data.m;
+      graph.offsets = arena.Allocate<c_int>(graph.num_nodes + 1);
+      std::fill(graph.offsets, graph.offsets + graph.num_nodes + 1, 0);
+
+      // Count, then fill
+      for(c_int col = 0; col < n; ++col) {
+        for(c_int nz_idx = P->p[col]; nz_idx < P->p[col + 1]; ++nz_idx) {
+          if(P->i[nz_idx] != col) {
+            graph.offsets[P->i[nz_idx] + 1]++;
+            graph.offsets[col + 1]++;
+          }
+        }
+        for(c_int nz_idx = A->p[col]; nz_idx < A->p[col + 1]; ++nz_idx) {
+          graph.offsets[n + A->i[nz_idx] + 1]++;
+          graph.offsets[col + 1]++;
+        }
+      }
+      for(c_int node = 0; node < graph.num_nodes; ++node) {
+        graph.offsets[node + 1] += graph.offsets[node];
+      }
+
+      graph.neighbours = arena.Allocate<c_int>(graph.offsets[graph.num_nodes]);
+      c_int* next = arena.Allocate<c_int>(graph.num_nodes);
+      std::copy(graph.offsets, graph.offsets + graph.num_nodes, next);
+      for(c_int col = 0; col < n; ++col) {
+        for(c_int nz_idx = P->p[col]; nz_idx < P->p[col + 1]; ++nz_idx) {
+          const c_int row = P->i[nz_idx];
+          if(row != col) {
+            graph.neighbours[next[row]++] = col;
+            graph.neighbours[next[col]++] = row;
+          }
+        }
+        for(c_int nz_idx = A->p[col]; nz_idx < A->p[col + 1]; ++nz_idx) {
+          const c_int row = n + A->i[nz_idx];
+          graph.neighbours[next[row]++] = col;
+          graph.neighbours[next[col]++] = row;
+        }
+      }
+      return graph;
+    }
+
+    c_int Degree(
+        const Graph& graph,
+        const c_int node) {
+      return graph.offsets[node + 1] - graph.offsets[node];
+    }
+
+    // Breadth-first search from a node. Returns the node of lowest degree in
+    // the last level, which is far from the start and a good start for
+    // Cuthill-McKee. Marks every reached node with the stamp.
+    c_int FarthestNode(
+        const Graph& graph,
+        const c_int start,
+        const c_int stamp,
+        c_int* marks,
+        c_int* queue) {
+      c_int head = 0;
+      c_int tail = 0;
+      queue[tail++] = start;
+      marks[start] = stamp;
+      c_int level_begin = 0;
+      while(head < tail) {
+        const c_int level_end = tail;
+        level_begin = head;
+        for(; head < level_end; ++head) {
+          const c_int node = queue[head];
+          for(c_int idx = graph.offsets[node]; idx < graph.offsets[node + 1]; ++idx) {
+            const c_int neighbour = graph.neighbours[idx];
+            if(stamp != marks[neighbour]) {
+              marks[neighbour] = stamp;
+              queue[tail++] = neighbour;
+            }
+          }
+        }
+      }
+
+      c_int farthest = queue[level_begin];
+      for(c_int idx = level_begin; idx < tail; ++idx) {
+        if(Degree(graph, queue[idx]) < Degree(graph, farthest)) {
+          farthest = queue[idx];
+        }
+      }
+      return farthest;
+    }
+
+    // Entries of a banded matrix with half bandwidth b that has room for the
+    // fill of partial pivoting: row i holds columns [i - b, i + 2b]
+    class BandMatrix {
+      public:
+        BandMatrix(
+            const c_int size,
+            const c_int bandwidth,
+            Arena& arena)
+          : bandwidth_(bandwidth),
+            width_(3 * bandwidth + 1),
+            entries_(arena.Allocate<double>(size * (3 * bandwidth + 1))) {
+          std::fill(this->entries_, this->entries_ + size * this->width_, 0);
+        }
+
+        double& operator()(
+            const c_int row,
+            const c_int col) {
+          return this->entries_[row * this->width_ + col - row + this->bandwidth_];
+        }
+
+      private:
+        c_int bandwidth_;
+        c_int width_;
+        double* entries_;
+    };
+  }
+
+  bool DirectSolver::Applicable(const OSQPData& data) {
+    for(c_int row = 0; row < data.m; ++row) {
+      if(data.l[row] != data.u[row] || std::abs(data.l[row]) >= OSQP_INFTY) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void DirectSolver::Order(
+      const OSQPData& data,
+      c_int* positions,
+      Arena& arena) {
+    const Graph graph = MakeGraph(data, arena);
+    const c_int num_nodes = graph.num_nodes;
+
+    c_int* marks = arena.Allocate<c_int>(num_nodes);
+    c_int* queue = arena.Allocate<c_int>(num_nodes);
+    c_int* order = arena.Allocate<c_int>(num_nodes);
+    std::fill(marks, marks + num_nodes, -1);
+    std::fill(positions, positions + num_nodes, -1);
+
+    // Every connected component is ordered on its own, starting from a node
+    // far from its first node
+    c_int num_ordered = 0;
+    for(c_int node = 0; node < num_nodes; ++node) {
+      if(-1 != positions[node]) {
+        continue;
+      }
+      const c_int start = FarthestNode(graph, node, node, marks, queue);
+
+      c_int head = num_ordered;
+      positions[start] = num_ordered;
+      order[num_ordered++] = start;
+      while(head < num_ordered) {
+        const c_int current = order[head++];
+        // Unordered neighbours, lowest degree first
+        const c_int first = num_ordered;
+        for(c_int idx = graph.offsets[current]; idx < graph.offsets[current + 1]; ++idx) {
+          const c_int neighbour = graph.neighbours[idx];
+          if(-1 == positions[neighbour]) {
+            positions[neighbour] = num_ordered;
+            order[num_ordered++] = neighbour;
+          }
+        }
+        std::sort(order + first, order + num_ordered, [&graph](const c_int lhs, const c_int rhs) {
+          const c_int lhs_degree = Degree(graph, lhs);
+          const c_int rhs_degree = Degree(graph, rhs);
+          return lhs_degree < rhs_degree || (lhs_degree == rhs_degree && lhs < rhs);
+        });
+        for(c_int idx = first; idx < num_ordered; ++idx) {
+          positions[order[idx]] = idx;
+        }
+      }
+    }
+  }
+
+  bool DirectSolver::Solve(
+      const OSQPData& data,
+      const OSQPSettings& settings,
+      Arena& arena) {
+    const csc* P = data.P;
+    const csc* A = data.A;
+    const c_int n = data.n;
+    const c_int m = data.m;
+    const c_int size = n + m;
+
+    c_int* positions = arena.Allocate<c_int>(size);
+    this->Order(data, positions, arena);
+
+    // Half bandwidth of the ordered system
+    c_int bandwidth = 0;
+    for(c_int col = 0; col < n; ++col) {
+      for(c_int nz_idx = P->p[col]; nz_idx < P->p[col + 1]; ++nz_idx) {
+        bandwidth = std::max(bandwidth, std::abs(positions[P->i[nz_idx]] - positions[col]));
+      }
+      for(c_int nz_idx = A->p[col]; nz_idx < A->p[col + 1]; ++nz_idx) {
+        bandwidth = std::max(bandwidth, std::abs(positions[n + A->i[nz_idx]] - positions[col]));
+      }
+    }
+    this->bandwidth_ = bandwidth;
+
+    // P is given as its upper triangle
+    BandMatrix kkt(size, bandwidth, arena);
+    double* rhs = arena.Allocate<double>(size);
+    double max_abs = 0;
+    for(c_int col = 0; col < n; ++col) {
+      const c_int col_position = positions[col];
+      for(c_int nz_idx = P->p[col]; nz_idx < P->p[col + 1]; ++nz_idx) {
+        const c_int row_position = positions[P->i[nz_idx]];
+        kkt(row_position, col_position) += P->x[nz_idx];
+        if(row_position != col_position) {
+          kkt(col_position, row_position) += P->x[nz_idx];
+        }
+        max_abs = std::max(max_abs, std::abs(P->x[nz_idx]));
+      }
+      for(c_int nz_idx = A->p[col]; nz_idx < A->p[col + 1]; ++nz_idx) {
+        const c_int row_position = positions[n + A->i[nz_idx]];
+        kkt(row_position, col_position) += A->x[nz_idx];
+        kkt(col_position, row_position) += A->x[nz_idx];
+        max_abs = std::max(max_abs, std::abs(A->x[nz_idx]));
+      }
+      rhs[col_position] = -data.q[col];
+    }
+    for(c_int row = 0; row < m; ++row) {
+      rhs[positions[n + row]] = data.l[row];
+    }
+
+    // Gaussian elimination with partial pivoting. A row swap within the
+    // band moves entries at most bandwidth columns to the right, into the
+    // room reserved for the fill.
+    const double pivot_tolerance = kPivotTolerance * max_abs;
+    for(c_int k = 0; k < size; ++k) {
+      const c_int last_row = std::min(size - 1, k + bandwidth);
+      const c_int last_col = std::min(size - 1, k + 2 * bandwidth);
+
+      c_int pivot_row = k;
+      for(c_int row = k + 1; row <= last_row; ++row) {
+        if(std::abs(kkt(row, k)) > std::abs(kkt(pivot_row, k))) {
+          pivot_row = row;
+        }
+      }
+      if(std::abs(kkt(pivot_row, k)) <= pivot_tolerance) {
+        return false;
+      }
+      if(pivot_row != k) {
+        for(c_int col = k; col <= last_col; ++col) {
+          std::swap(kkt(k, col), kkt(pivot_row, col));
+        }
+        std::swap(rhs[k], rhs[pivot_row]);
+      }
+
+      const double pivot = kkt(k, k);
+      for(c_int row = k + 1; row <= last_row; ++row) {
+        const double factor = kkt(row, k) / pivot;
+        if(0 == factor) {
+          continue;
+        }
+        for(c_int col = k; col <= last_col; ++col) {
+          kkt(row, col) -= factor * kkt(k, col);
+        }
+        rhs[row] -= factor * rhs[k];
+      }
+    }
+
+    // Back substitution, in place
+    for(c_int k = size - 1; k >= 0; --k) {
+      const c_int last_col = std::min(size - 1, k + 2 * bandwidth);
+      double value = rhs[k];
+      for(c_int col = k + 1; col <= last_col; ++col) {
+        value -= kkt(k, col) * rhs[col];
+      }
+      rhs[k] = value / kkt(k, k);
+    }
+
+    this->x_ = arena.Allocate<c_float>(n);
+    this->y_ = arena.Allocate<c_float>(m);
+    for(c_int col = 0; col < n; ++col) {
+      this->x_[col] = rhs[positions[col]];
+    }
+    for(c_int row = 0; row < m; ++row) {
+      this->y_[row] = rhs[positions[n + row]];
+    }
+
+    return this->Converged(data, settings, arena);
+  }
+
+  bool DirectSolver::Converged(
+      const OSQPData& data,
+      const OSQPSettings& settings,
+      Arena& arena) {
+    const csc* P = data.P;
+    const csc* A = data.A;
+    const c_int n = data.n;
+    const c_int m = data.m;
+    const c_float* x = this->x_;
+    const c_float* y = this->y_;
+
+    c_float* Px = arena.Allocate<c_float>(n);
+    c_float* Aty = arena.Allocate<c_float>(n);
+    c_float* Ax = arena.Allocate<c_float>(m);
+    std::fill(Px, Px + n, 0);
+    std::fill(Ax, Ax + m, 0);
+    for(c_int col = 0; col < n; ++col) {
+      for(c_int nz_idx = P->p[col]; nz_idx < P->p[col + 1]; ++nz_idx) {
+        const c_int row = P->i[nz_idx];
+        Px[row] += P->x[nz_idx] * x[col];
+        if(row != col) {
+          Px[col] += P->x[nz_idx] * x[row];
+        }
+      }
+      double value = 0;
+      for(c_int nz_idx = A->p[col]; nz_idx < A->p[col + 1]; ++nz_idx) {
+        Ax[A->i[nz_idx]] += A->x[nz_idx] * x[col];
+        value += A->x[nz_idx] * y[A->i[nz_idx]];
+      }
+      Aty[col] = value;
+    }
+
+    // Residuals and their scales as in the termination criteria of OSQP
+    double primal_residual = 0;
+    for(c_int row = 0; row < m; ++row) {
+      primal_residual = std::max(primal_residual, std::abs(Ax[row] - data.l[row]));
+    }
+    const double primal_scale = std::max(MaxAbs(Ax, m), MaxAbs(data.l, m));
+
+    double dual_residual = 0;
+    this->objective_ = 0;
+    for(c_int col = 0; col < n; ++col) {
+      dual_residual = std::max(dual_residual, std::abs(Px[col] + data.q[col] + Aty[col]));
+      this->objective_ += (0.5 * Px[col] + data.q[col]) * x[col];
+    }
+    const double dual_scale
+      = std::max(MaxAbs(Px, n), std::max(MaxAbs(Aty, n), MaxAbs(data.q, n)));
+
+    return
+      primal_residual <= settings.eps_abs + settings.eps_rel * primal_scale &&
+      dual_residual <= settings.eps_abs + settings.eps_rel * dual_scale;
+  }
+}
@@ -0,0 +1,84 @@
+// Author: Tucker Haydon
+
+#pragma once
+
+#include <osqp.h>
+
+#include "arena.h"
+
+namespace p4 {
+  /* Direct solver for the QPs assembled by PolynomialSolver whose every row
+   * is an equality.
+   *
+   * The optimum of
+   *   argmin 0.5 x' P x + q' x  subject to  A x = b
+   * solves the linear KKT system
+   *   [ P  A' ] [ x ]   [ -q ]
+   *   [ A  0  ] [ y ] = [  b ]
+   * where y are the multipliers, with the sign convention of OSQP. Every row
+   * and every block of the cost only touches the coefficients of one or two
+   * neighbouring segments, so the system is banded once its unknowns follow
+   * the chain of segments. The unknowns are ordered with Cuthill-McKee,
+   * which recovers the chain from the sparsity pattern regardless of the
+   * variable ordering and formulation. The banded system is factorized by
+   * Gaussian elimination with partial pivoting, in time linear in the number
+   * of unknowns for a fixed bandwidth.
+   *
+   * Buffers are allocated in the arena passed to Solve.
+   */
+  class DirectSolver {
+    public:
+      DirectSolver() {}
+
+      // Whether every row of the problem is a finite equality
+      static bool Applicable(const OSQPData& data);
+
+      // Solves the problem. Returns false if the KKT system is singular, e.g.
+      // when rows are redundant or the constraints leave the optimum
+      // undetermined, or if the solution does not meet the termination
+      // tolerances of the settings. The problem should then be solved by
+      // OSQP.
+      bool Solve(
+          const OSQPData& data,
+          const OSQPSettings& settings,
+          Arena& arena);
+
+      // Solution. Valid after Solve returns true.
+      const c_float* X() const {
+        return this->x_;
+      }
+
+      const c_float* Y() const {
+        return this->y_;
+      }
+
+      // Optimal cost 0.5 x' P x + q' x
+      double Objective() const {
+        return this->objective_;
+      }
+
+      // Half bandwidth of the ordered KKT system
+      size_t Bandwidth() const {
+        return this->bandwidth_;
+      }
+
+    private:
+      // Orders the unknowns of the KKT system with Cuthill-McKee. Writes the
+      // position of every unknown.
+      void Order(
+          const OSQPData& data,
+          c_int* positions,
+          Arena& arena);
+
+      // Whether the solution meets the termination tolerances of OSQP
+      bool Converged(
+          const OSQPData& data,
+          const OSQPSettings& settings,
+          Arena& arena);
+
+      c_float* x_ = nullptr;
+      c_float* y_ = nullptr;
+      double objective_ = 0;
+      size_t bandwidth_ = 0;
+  };
+}
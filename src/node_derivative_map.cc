@@ -0,0 +1,336 @@
+// Author: Tucker Haydon
+
+#include <algorithm>
+#include <cmath>
+
+#include <Eigen/Dense>
+
+#include "node_derivative_map.h"
+#include "common.h"
+
+namespace p4 {
+  namespace {
+    csc* AllocateCsc(
+        const size_t m,
+        const size_t n,
+        const size_t num_nz,
+        Arena& arena) {
+      csc* mat = arena.Allocate<csc>(1);
+      mat->m = m;
+      mat->n = n;
+      mat->nzmax = num_nz;
+      mat->nz = -1;
+      mat->p = arena.Allocate<c_int>(n + 1);
+      mat->i = arena.Allocate<c_int>(num_nz);
+      mat->x = arena.Allocate<c_float>(num_nz);
+      return mat;
+    }
+  }
+
+  NodeDerivativeMap::NodeDerivativeMap(
+      const VariableLayout& layout,
+      const size_t num_dimensions,
+      const size_t polynomial_order,
+      const size_t continuity_order,
+      const PolynomialBasis& basis,
+      const std::vector<double>& times,
+      Arena& arena)
+    : layout_(layout),
+      num_dimensions_(num_dimensions),
+      num_segments_(times.size() - 1),
+      num_coefficients_(polynomial_order + 1),
+      num_derivatives_(continuity_order + 1),
+      num_interior_(polynomial_order + 1 - 2 * (continuity_order + 1)),
+      num_segment_variables_(polynomial_order + 1),
+      num_variables_(num_dimensions * (times.size() * (continuity_order + 1)
+            + (times.size() - 1) * (polynomial_order + 1 - 2 * (continuity_order + 1)))) {
+    const size_t num_derivatives = num_derivatives_;
+    const size_t num_vars = num_segment_variables_;
+
+    // The first 2 * num_derivatives coefficients follow from the derivatives
+    // at both ends of the segment, and the remaining num_interior
+    // coefficients are the interior variables. With the basis rows
+    //   [ G H ] c = [ start; end ]
+    // at tau = 0 and tau = 1, the head coefficients are
+    //   G^-1 ([ start; end ] - H interior)
+    // G is invertible: the head functions span the polynomials of degree
+    // below 2 * num_derivatives, which Hermite interpolation determines.
+    const size_t num_head = 2 * num_derivatives;
+    Eigen::MatrixXd head(num_head, num_head);
+    Eigen::MatrixXd tail(num_head, num_interior_);
+    double row[kMaxPolynomialOrder + 1];
+    for(size_t derivative_idx = 0; derivative_idx < num_derivatives; ++derivative_idx) {
+      for(size_t end_idx = 0; end_idx < 2; ++end_idx) {
+        basis.TimeVector(derivative_idx, 0 == end_idx ? 0.0 : 1.0, row);
+        const size_t head_row = end_idx * num_derivatives + derivative_idx;
+        for(size_t idx = 0; idx < num_head; ++idx) {
+          head(head_row, idx) = row[idx];
+        }
+        for(size_t idx = 0; idx < num_interior_; ++idx) {
+          tail(head_row, idx) = row[num_head + idx];
+        }
+      }
+    }
+    const Eigen::MatrixXd head_inverse = head.inverse();
+    const Eigen::MatrixXd head_interior = -head_inverse * tail;
+
+    this->map_ = arena.Allocate<double>(num_coefficients_ * num_vars);
+    std::fill(this->map_, this->map_ + num_coefficients_ * num_vars, 0);
+    for(size_t row_idx = 0; row_idx < num_head; ++row_idx) {
+      for(size_t col = 0; col < num_head; ++col) {
+        this->map_[row_idx * num_vars + col] = head_inverse(row_idx, col);
+      }
+      for(size_t col = 0; col < num_interior_; ++col) {
+        this->map_[row_idx * num_vars + num_head + col] = head_interior(row_idx, col);
+      }
+    }
+    for(size_t idx = 0; idx < num_interior_; ++idx) {
+      this->map_[(num_head + idx) * num_vars + num_head + idx] = 1;
+    }
+
+    this->scales_ = arena.Allocate<double>(num_segments_ * num_vars);
+    this->UpdateTimes(times);
+  }
+
+  void NodeDerivativeMap::UpdateTimes(
+      const std::vector<double>& times) {
+    const size_t num_derivatives = num_derivatives_;
+    const size_t num_vars = num_segment_variables_;
+
+    // Derivative k in tau units is alpha^k times derivative k in real time
+    for(size_t segment_idx = 0; segment_idx < num_segments_; ++segment_idx) {
+      const double alpha = times[segment_idx + 1] - times[segment_idx];
+      double* scales = this->scales_ + segment_idx * num_vars;
+      double alpha_power = 1.0;
+      for(size_t derivative_idx = 0; derivative_idx < num_derivatives; ++derivative_idx) {
+        scales[derivative_idx] = alpha_power;
+        scales[num_derivatives + derivative_idx] = alpha_power;
+        alpha_power *= alpha;
+      }
+      std::fill(scales + 2 * num_derivatives, scales + num_vars, 1.0);
+    }
+  }
+
+  size_t NodeDerivativeMap::NodeIndex(
+      const size_t dimension_idx,
+      const size_t node_idx,
+      const size_t derivative_idx) const {
+    const size_t group_size = num_derivatives_ + num_interior_;
+    const size_t group_start = VariableOrdering::DIMENSION_MAJOR == layout_.Ordering()
+      ? dimension_idx * (num_variables_ / num_dimensions_) + node_idx * group_size
+      // The final node has no interior variables
+      : node_idx * num_dimensions_ * group_size
+        + dimension_idx * (node_idx < num_segments_ ? group_size : num_derivatives_);
+    return group_start + derivative_idx;
+  }
+
+  void NodeDerivativeMap::SegmentIndices(
+      const size_t dimension_idx,
+      const size_t segment_idx,
+      c_int* indices) const {
+    const size_t start = this->NodeIndex(dimension_idx, segment_idx, 0);
+    const size_t end = this->NodeIndex(dimension_idx, segment_idx + 1, 0);
+    for(size_t idx = 0; idx < num_derivatives_; ++idx) {
+      indices[idx] = start + idx;
+      indices[num_derivatives_ + idx] = end + idx;
+    }
+    // Interior variables follow the start node derivatives
+    for(size_t idx = 0; idx < num_interior_; ++idx) {
+      indices[2 * num_derivatives_ + idx] = start + num_derivatives_ + idx;
+    }
+  }
+
+  csc* NodeDerivativeMap::MapConstraints(
+      const csc* constraint_mat,
+      Arena& arena) const {
+    const csc* A = constraint_mat;
+    const c_int m = A->m;
+    const c_int n = A->n;
+    const size_t num_vars = num_segment_variables_;
+
+    // Row-wise copy of A. Columns within a row are sorted, so the
+    // coefficients of a segment are contiguous.
+    c_int* row_ptrs = arena.Allocate<c_int>(m + 1);
+    std::fill(row_ptrs, row_ptrs + m + 1, 0);
+    for(c_int nz_idx = 0; nz_idx < A->p[n]; ++nz_idx) {
+      row_ptrs[A->i[nz_idx] + 1]++;
+    }
+    for(c_int row = 0; row < m; ++row) {
+      row_ptrs[row + 1] += row_ptrs[row];
+    }
+    c_int* row_cols = arena.Allocate<c_int>(A->p[n]);
+    c_float* row_values = arena.Allocate<c_float>(A->p[n]);
+    c_int* cursor = arena.Allocate<c_int>(std::max<size_t>(m, num_variables_));
+    std::copy(row_ptrs, row_ptrs + m, cursor);
+    for(c_int col = 0; col < n; ++col) {
+      for(c_int nz_idx = A->p[col]; nz_idx < A->p[col + 1]; ++nz_idx) {
+        const c_int pos = cursor[A->i[nz_idx]]++;
+        row_cols[pos] = col;
+        row_values[pos] = A->x[nz_idx];
+      }
+    }
+
+    // Two passes: count the entries of every column, then write them. Rows
+    // are visited in order, so row indices within each column are sorted.
+    c_int* column_ptrs = arena.Allocate<c_int>(num_variables_ + 1);
+    std::fill(column_ptrs, column_ptrs + num_variables_ + 1, 0);
+    double* row_coefficients = arena.Allocate<double>(num_coefficients_);
+    c_int* indices = arena.Allocate<c_int>(num_vars);
+    csc* mapped_mat = nullptr;
+
+    for(size_t pass = 0; pass < 2; ++pass) {
+      for(c_int row = 0; row < m; ++row) {
+        c_int pos = row_ptrs[row];
+        while(pos < row_ptrs[row + 1]) {
+          const size_t block_idx = row_cols[pos] / num_coefficients_;
+          std::fill(row_coefficients, row_coefficients + num_coefficients_, 0);
+          for(; pos < row_ptrs[row + 1] && row_cols[pos] / num_coefficients_ == block_idx; ++pos) {
+            row_coefficients[row_cols[pos] % num_coefficients_] = row_values[pos];
+          }
+
+          const size_t segment_idx = layout_.BlockSegment(block_idx);
+          this->SegmentIndices(layout_.BlockDimension(block_idx), segment_idx, indices);
+          const double* scales = this->scales_ + segment_idx * num_vars;
+          for(size_t var_idx = 0; var_idx < num_vars; ++var_idx) {
+            double value = 0;
+            for(size_t coefficient_idx = 0; coefficient_idx < num_coefficients_; ++coefficient_idx) {
+              value += row_coefficients[coefficient_idx] * this->map_[coefficient_idx * num_vars + var_idx];
+            }
+            if(0.0 == value) {
+              continue;
+            }
+
+            if(0 == pass) {
+              column_ptrs[indices[var_idx] + 1]++;
+            } else {
+              const c_int nz_idx = cursor[indices[var_idx]]++;
+              mapped_mat->i[nz_idx] = row;
+              mapped_mat->x[nz_idx] = value * scales[var_idx];
+            }
+          }
+        }
+      }
+
+      if(0 == pass) {
+        for(size_t col = 0; col < num_variables_; ++col) {
+          column_ptrs[col + 1] += column_ptrs[col];
+        }
+        mapped_mat = AllocateCsc(m, num_variables_, column_ptrs[num_variables_], arena);
+        std::copy(column_ptrs, column_ptrs + num_variables_ + 1, mapped_mat->p);
+        std::copy(column_ptrs, column_ptrs + num_variables_, cursor);
+      }
+    }
+
+    return mapped_mat;
+  }
+
+  csc* NodeDerivativeMap::MapQuadraticCost(
+      const double* quadratic_matrix,
+      Arena& arena) const {
+    const size_t num_vars = num_segment_variables_;
+
+    // H0 = M0^T Q M0, shared by every segment up to the scaling S
+    Eigen::MatrixXd quadratic(num_coefficients_, num_coefficients_);
+    Eigen::MatrixXd map(num_coefficients_, num_vars);
+    for(size_t row = 0; row < num_coefficients_; ++row) {
+      for(size_t col = 0; col < num_coefficients_; ++col) {
+        quadratic(row, col) = quadratic_matrix[col * num_coefficients_ + row];
+      }
+      for(size_t col = 0; col < num_vars; ++col) {
+        map(row, col) = this->map_[row * num_vars + col];
+      }
+    }
+    const Eigen::MatrixXd mapped_quadratic = map.transpose() * quadratic * map;
+
+    // Neighbouring segments share node derivatives. Entries are scattered
+    // per segment, then sorted and summed within each column.
+    c_int* indices = arena.Allocate<c_int>(num_vars);
+    c_int* column_ptrs = arena.Allocate<c_int>(num_variables_ + 1);
+    std::fill(column_ptrs, column_ptrs + num_variables_ + 1, 0);
+    const size_t num_blocks = layout_.NumBlocks();
+    for(size_t block_idx = 0; block_idx < num_blocks; ++block_idx) {
+      this->SegmentIndices(layout_.BlockDimension(block_idx), layout_.BlockSegment(block_idx), indices);
+      for(size_t col = 0; col < num_vars; ++col) {
+        for(size_t row = 0; row < num_vars; ++row) {
+          if(indices[row] <= indices[col] && 0.0 != mapped_quadratic(row, col)) {
+            column_ptrs[indices[col] + 1]++;
+          }
+        }
+      }
+    }
+    for(size_t col = 0; col < num_variables_; ++col) {
+      column_ptrs[col + 1] += column_ptrs[col];
+    }
+
+    csc* quadratic_mat = AllocateCsc(num_variables_, num_variables_, column_ptrs[num_variables_], arena);
+    c_int* cursor = arena.Allocate<c_int>(num_variables_);
+    std::copy(column_ptrs, column_ptrs + num_variables_, cursor);
+    for(size_t block_idx = 0; block_idx < num_blocks; ++block_idx) {
+      const size_t segment_idx = layout_.BlockSegment(block_idx);
+      const double* scales = this->scales_ + segment_idx * num_vars;
+      this->SegmentIndices(layout_.BlockDimension(block_idx), segment_idx, indices);
+      for(size_t col = 0; col < num_vars; ++col) {
+        for(size_t row = 0; row < num_vars; ++row) {
+          if(indices[row] <= indices[col] && 0.0 != mapped_quadratic(row, col)) {
+            const c_int nz_idx = cursor[indices[col]]++;
+            quadratic_mat->i[nz_idx] = indices[row];
+            quadratic_mat->x[nz_idx] = scales[row] * scales[col] * mapped_quadratic(row, col);
+          }
+        }
+      }
+    }
+
+    // Sort every column by row and sum duplicates, compacting in place
+    c_int write_idx = 0;
+    for(size_t col = 0; col < num_variables_; ++col) {
+      const c_int begin = column_ptrs[col];
+      const c_int end = column_ptrs[col + 1];
+      for(c_int idx = begin + 1; idx < end; ++idx) {
+        const c_int row = quadratic_mat->i[idx];
+        const c_float value = quadratic_mat->x[idx];
+        c_int pos = idx;
+        for(; pos > begin && quadratic_mat->i[pos - 1] > row; --pos) {
+          quadratic_mat->i[pos] = quadratic_mat->i[pos - 1];
+          quadratic_mat->x[pos] = quadratic_mat->x[pos - 1];
+        }
+        quadratic_mat->i[pos] = row;
+        quadratic_mat->x[pos] = value;
+      }
+
+      quadratic_mat->p[col] = write_idx;
+      for(c_int idx = begin; idx < end; ++idx) {
+        if(write_idx > quadratic_mat->p[col] && quadratic_mat->i[write_idx - 1] == quadratic_mat->i[idx]) {
+          quadratic_mat->x[write_idx - 1] += quadratic_mat->x[idx];
+          continue;
+        }
+        quadratic_mat->i[write_idx] = quadratic_mat->i[idx];
+        quadratic_mat->x[write_idx] = quadratic_mat->x[idx];
+        write_idx++;
+      }
+    }
+    quadratic_mat->p[num_variables_] = write_idx;
+    quadratic_mat->nzmax = write_idx;
+
+    return quadratic_mat;
+  }
+
+  void NodeDerivativeMap::Coefficients(
+      const double* variables,
+      double* coefficients) const {
+    const size_t num_vars = num_segment_variables_;
+    c_int indices[2 * (kMaxPolynomialOrder + 1)];
+    for(size_t block_idx = 0; block_idx < layout_.NumBlocks(); ++block_idx) {
+      const size_t dimension_idx = layout_.BlockDimension(block_idx);
+      const size_t segment_idx = layout_.BlockSegment(block_idx);
+      const double* scales = this->scales_ + segment_idx * num_vars;
+      this->SegmentIndices(dimension_idx, segment_idx, indices);
+      for(size_t coefficient_idx = 0; coefficient_idx < num_coefficients_; ++coefficient_idx) {
+        double value = 0;
+        for(size_t var_idx = 0; var_idx < num_vars; ++var_idx) {
+          value += this->map_[coefficient_idx * num_vars + var_idx] * scales[var_idx] * variables[indices[var_idx]];
+        }
+        coefficients[layout_.Index(dimension_idx, segment_idx, coefficient_idx)] = value;
+      }
+    }
+  }
+}
@@ -0,0 +1,109 @@
+// Author: Tucker Haydon
+
+#pragma once
+
+#include <vector>
+
+#include <osqp.h>
+
+#include "arena.h"
+#include "polynomial_basis.h"
+#include "variable_layout.h"
+
+namespace p4 {
+  /* Maps the QP over polynomial coefficients onto a QP over node derivatives.
+   *
+   * The decision variables of a dimension are the derivatives 0 through
+   * continuity_order at every node, in real time units, plus the remaining
+   * polynomial_order + 1 - 2 * (continuity_order + 1) coefficients of every
+   * segment, which are not fixed by the derivatives at its two nodes. The
+   * coefficients of a segment follow from its variables through a fixed
+   * linear map
+   *   c = M0 * S * z
+   * where z stacks the start node derivatives, the end node derivatives and
+   * the interior coefficients of the segment, S scales the derivatives into
+   * tau units and M0 is shared by every segment. Coefficients are in the
+   * basis of the problem, and the interior variables are the coefficients
+   * of its highest-degree functions. Neighbouring segments share
+   * node derivatives, so continuity holds by construction.
+   *
+   * Variables are grouped per (dimension, node): the derivatives of the node
+   * followed by the interior coefficients of the segment starting at the
+   * node. Groups follow the variable ordering of the coefficient layout.
+   *
+   * Buffers are allocated in the arena passed to the constructor.
+   */
+  class NodeDerivativeMap {
+    public:
+      NodeDerivativeMap(
+          const VariableLayout& layout,
+          const size_t num_dimensions,
+          const size_t polynomial_order,
+          const size_t continuity_order,
+          const PolynomialBasis& basis,
+          const std::vector<double>& times,
+          Arena& arena);
+
+      // Replaces the segment durations. Only the scaling S changes; mapped
+      // matrices must be mapped again.
+      void UpdateTimes(
+          const std::vector<double>& times);
+
+      // Number of node derivative variables
+      size_t NumVariables() const {
+        return this->num_variables_;
+      }
+
+      // Maps a constraint matrix over the coefficients of the layout onto the
+      // variables. Every row may only touch coefficients of a single segment
+      // of each dimension.
+      csc* MapConstraints(
+          const csc* constraint_mat,
+          Arena& arena) const;
+
+      // Maps the per-segment quadratic cost block, stored column-major, onto
+      // the variables. Returns the upper triangle.
+      csc* MapQuadraticCost(
+          const double* quadratic_matrix,
+          Arena& arena) const;
+
+      // Writes the coefficients, in the coefficient layout, given the
+      // variables
+      void Coefficients(
+          const double* variables,
+          double* coefficients) const;
+
+    private:
+      // Index of a derivative of a node
+      size_t NodeIndex(
+          const size_t dimension_idx,
+          const size_t node_idx,
+          const size_t derivative_idx) const;
+
+      // Writes the variable indices of a segment in the column order of M0
+      void SegmentIndices(
+          const size_t dimension_idx,
+          const size_t segment_idx,
+          c_int* indices) const;
+
+      VariableLayout layout_;
+      size_t num_dimensions_;
+      size_t num_segments_;
+      // Coefficients per segment
+      size_t num_coefficients_;
+      // Derivatives per node
+      size_t num_derivatives_;
+      // Interior coefficients per segment
+      size_t num_interior_;
+      // Variables per segment: 2 * num_derivatives_ + num_interior_
+      size_t num_segment_variables_;
+      size_t num_variables_;
+
+      // M0. num_coefficients_ x num_segment_variables_, row-major.
+      double* map_;
+
+      // Diagonal of S for every segment. num_segments_ x
+      // num_segment_variables_, row-major.
+      double* scales_;
+  };
+}
@@ -0,0 +1,281 @@
+// Author: Tucker Haydon
+
+#include <algorithm>
+#include <cmath>
+
+#include "polynomial_basis.h"
+
+namespace p4 {
+  namespace {
+    // Generates a square matrix that is the integrated form of d^n/dt^n [p(x)'p(x)].
+    // The derivative of this matrix can be easily calculated by computing the
+    // zeroth derivative of the matrix, padding the first n rows and columns
+    // with zeros, and shifting the matrix down and to the right by n
+    // rows/columns.
+    //
+    // The matrix is written column-major into a caller-provided buffer of
+    // (polynomial_order + 1)^2 elements.
+    //
+    // See the theory documentation for further details.
+    void MonomialQuadraticMatrix(
+        const size_t polynomial_order,
+        const size_t derivative_order,
+        const double dt,
+        double* quadratic_matrix) {
+      const size_t num_params = polynomial_order + 1;
+
+      // Powers of dt. The largest exponent is 2 * polynomial_order + 1.
+      double dt_powers[2 * (kMaxPolynomialOrder + 1)];
+      dt_powers[0] = 1.0;
+      for(size_t idx = 1; idx < 2 * num_params; ++idx) {
+        dt_powers[idx] = dt_powers[idx - 1] * dt;
+      }
+
+      for(size_t col = 0; col < num_params; ++col) {
+        for(size_t row = 0; row < num_params; ++row) {
+          double& entry = quadratic_matrix[col * num_params + row];
+          if(row < derivative_order || col < derivative_order) {
+            entry = 0;
+            continue;
+          }
+
+          // Shifted indices
+          const size_t base_row = row - derivative_order;
+          const size_t base_col = col - derivative_order;
+          entry =
+            dt_powers[base_row + base_col + 1]
+            * InverseFactorial(base_row)
+            * InverseFactorial(base_col)
+            / (base_row + base_col + 1);
+        }
+      }
+    }
+
+    // Both orthogonal bases follow a three-term recurrence in x = 2 tau - 1:
+    //   phi_{n+1}(x) = a_n x phi_n(x) - c_n phi_{n-1}(x)
+    // with phi_0 = 1.
+    void RecurrenceCoefficients(
+        const Basis basis,
+        const size_t n,
+        double& a,
+        double& c) {
+      if(0 == n) {
+        a = 1;
+        c = 0;
+        return;
+      }
+      if(Basis::LEGENDRE == basis) {
+        a = (2.0 * n + 1.0) / (n + 1.0);
+        c = n / (n + 1.0);
+      } else {
+        a = 2;
+        c = 1;
+      }
+    }
+
+    // Gauss-Legendre nodes and weights on [0, 1]. Exact for polynomials of
+    // degree up to 2 * num_points - 1.
+    void GaussLegendre(
+        const size_t num_points,
+        double* nodes,
+        double* weights) {
+      const double pi = std::acos(-1.0);
+      for(size_t point_idx = 0; point_idx < num_points; ++point_idx) {
+        // Newton iteration on P_N from the Chebyshev-like initial guess
+        double x = std::cos(pi * (point_idx + 0.75) / (num_points + 0.5));
+        double derivative = 1;
+        for(size_t iteration = 0; iteration < 100; ++iteration) {
+          double p_prev = 1;
+          double p = x;
+          for(size_t n = 1; n < num_points; ++n) {
+            const double p_next = ((2.0 * n + 1.0) * x * p - n * p_prev) / (n + 1.0);
+            p_prev = p;
+            p = p_next;
+          }
+          derivative = num_points * (x * p - p_prev) / (x * x - 1.0);
+          const double step = p / derivative;
+          x -= step;
+          if(std::abs(step) < 1e-15) {
+            break;
+          }
+        }
+        nodes[point_idx] = 0.5 * (x + 1.0);
+        weights[point_idx] = 1.0 / ((1.0 - x * x) * derivative * derivative);
+      }
+    }
+  }
+
+  PolynomialBasis::PolynomialBasis(
+      const Basis basis,
+      const size_t polynomial_order)
+    : basis_(basis),
+      num_params_(polynomial_order + 1) {
+    const size_t num_params = num_params_;
+    double* to_monomial = this->to_monomial_;
+    std::fill(to_monomial, to_monomial + num_params * num_params, 0);
+
+    if(Basis::MONOMIAL == basis) {
+      for(size_t idx = 0; idx < num_params; ++idx) {
+        to_monomial[idx * num_params + idx] = 1;
+      }
+      return;
+    }
+
+    // Power series of every basis function in tau, column n of to_monomial,
+    // built with the recurrence. Multiplying by x = 2 tau - 1 shifts the
+    // series up by one power.
+    to_monomial[0] = 1;
+    for(size_t n = 0; n + 1 < num_params; ++n) {
+      double a, c;
+      RecurrenceCoefficients(basis, n, a, c);
+      for(size_t power = 0; power <= n + 1; ++power) {
+        double value = 0;
+        if(power >= 1) {
+          value += 2 * a * to_monomial[(power - 1) * num_params + n];
+        }
+        if(power <= n) {
+          value -= a * to_monomial[power * num_params + n];
+        }
+        if(n >= 1 && power + 1 <= n) {
+          value -= c * to_monomial[power * num_params + n - 1];
+        }
+        to_monomial[power * num_params + n + 1] = value;
+      }
+    }
+
+    // The coefficient of 1/k! tau^k is k! times the coefficient of tau^k
+    for(size_t power = 0; power < num_params; ++power) {
+      const double factorial = 1.0 / InverseFactorial(power);
+      for(size_t n = 0; n < num_params; ++n) {
+        to_monomial[power * num_params + n] *= factorial;
+      }
+    }
+  }
+
+  void PolynomialBasis::TimeVector(
+      const size_t derivative_order,
+      const double tau,
+      double* values) const {
+    const size_t num_params = num_params_;
+    if(Basis::MONOMIAL == this->basis_) {
+      p4::TimeVector(num_params - 1, derivative_order, tau, values);
+      return;
+    }
+    if(derivative_order >= num_params) {
+      std::fill(values, values + num_params, 0);
+      return;
+    }
+
+    // Differentiating the recurrence m times gives
+    //   D^m phi_{n+1} = a_n (x D^m phi_n + m D^{m-1} phi_n) - c_n D^m phi_{n-1}
+    // so the derivatives are built up one order at a time. Derivatives are
+    // taken with respect to x; d/dtau = 2 d/dx.
+    const double x = 2.0 * tau - 1.0;
+    double lower[kMaxPolynomialOrder + 1];
+    double scale = 1;
+    for(size_t m = 0; m <= derivative_order; ++m) {
+      for(size_t n = 0; n < num_params; ++n) {
+        double value = 0;
+        if(0 == n) {
+          value = 0 == m ? 1 : 0;
+        } else {
+          double a, c;
+          RecurrenceCoefficients(this->basis_, n - 1, a, c);
+          value = a * x * values[n - 1];
+          if(m > 0) {
+            value += a * m * lower[n - 1];
+          }
+          if(n >= 2) {
+            value -= c * values[n - 2];
+          }
+        }
+        values[n] = value;
+      }
+      if(m < derivative_order) {
+        std::copy(values, values + num_params, lower);
+        scale *= 2;
+      }
+    }
+
+    for(size_t n = 0; n < num_params; ++n) {
+      values[n] *= scale;
+    }
+  }
+
+  void PolynomialBasis::QuadraticMatrix(
+      const size_t derivative_order,
+      double* quadratic_matrix) const {
+    const size_t num_params = num_params_;
+    if(Basis::MONOMIAL == this->basis_) {
+      MonomialQuadraticMatrix(num_params - 1, derivative_order, 1.0, quadratic_matrix);
+      return;
+    }
+
+    // The integrand has degree at most 2 * (num_params - 1), so num_params
+    // points integrate it exactly
+    double nodes[kMaxPolynomialOrder + 1];
+    double weights[kMaxPolynomialOrder + 1];
+    double values[kMaxPolynomialOrder + 1];
+    GaussLegendre(num_params, nodes, weights);
+
+    std::fill(quadratic_matrix, quadratic_matrix + num_params * num_params, 0);
+    for(size_t point_idx = 0; point_idx < num_params; ++point_idx) {
+      this->TimeVector(derivative_order, nodes[point_idx], values);
+      for(size_t col = 0; col < num_params; ++col) {
+        for(size_t row = 0; row < num_params; ++row) {
+          quadratic_matrix[col * num_params + row] += weights[point_idx] * values[row] * values[col];
+        }
+      }
+    }
+  }
+
+  void PolynomialBasis::ControlPointMatrix(
+      const size_t derivative_order,
+      double* control_point_matrix) const {
+    const size_t num_params = num_params_;
+    if(derivative_order >= num_params) {
+      return;
+    }
+
+    // The derivative of 1/k! tau^k is 1/(k-1)! tau^(k-1), so differentiating
+    // shifts the monomial coefficients. The power series coefficients a_i of
+    // the derivative give its Bernstein coefficients of degree m as
+    //   b_j = sum_{i <= j} C(j,i) / C(m,i) a_i
+    const size_t degree = num_params - 1 - derivative_order;
+    for(size_t n = 0; n < num_params; ++n) {
+      double power_series[kMaxPolynomialOrder + 1];
+      for(size_t power = 0; power <= degree; ++power) {
+        power_series[power] 
+          = this->to_monomial_[(power + derivative_order) * num_params + n] * InverseFactorial(power);
+      }
+
+      for(size_t point_idx = 0; point_idx <= degree; ++point_idx) {
+        double value = 0;
+        for(size_t power = 0; power <= point_idx; ++power) {
+          // C(j,i) / C(m,i) = j! (m-i)! / (m! (j-i)!)
+          const double ratio 
+            = InverseFactorial(point_idx - power) * InverseFactorial(degree)
+            / (InverseFactorial(point_idx) * InverseFactorial(degree - power));
+          value += ratio * power_series[power];
+        }
+        control_point_matrix[point_idx * num_params + n] = value;
+      }
+    }
+  }
+
+  void PolynomialBasis::ToMonomial(
+      const double* coefficients,
+      const size_t num_coefficients,
+      double* monomial_coefficients) const {
+    // Basis function n has degree n, so the leading basis functions only
+    // touch the leading monomials
+    const size_t num_params = num_params_;
+    for(size_t power = 0; power < num_coefficients; ++power) {
+      double value = 0;
+      for(size_t n = 0; n < num_coefficients; ++n) {
+        value += this->to_monomial_[power * num_params + n] * coefficients[n];
+      }
+      monomial_coefficients[power] = value;
+    }
+  }
+}
@@ -0,0 +1,85 @@
+// Author: Tucker Haydon
+
+#pragma once
+
+#include <cstdlib>
+
+#include "common.h"
+
+namespace p4 {
+  // Basis in which the polynomial of every segment is expressed in the QP.
+  // Every basis spans the same polynomials; the choice only changes the
+  // conditioning of the problem handed to OSQP.
+  enum class Basis {
+    // Scaled monomials (1/k! tau^k). See PolynomialSolver.
+    MONOMIAL,
+    // Legendre polynomials shifted onto tau in [0, 1]. Orthogonal, so the
+    // cost of a zeroth-derivative problem is diagonal.
+    LEGENDRE,
+    // Chebyshev polynomials of the first kind shifted onto tau in [0, 1]
+    CHEBYSHEV
+  };
+
+  /* Evaluates the basis functions of a segment polynomial in normalized time
+   * tau in [0, 1].
+   *
+   * The Legendre and Chebyshev bases are evaluated with their three-term
+   * recurrences rather than through their monomial expansions, whose
+   * alternating coefficients cancel catastrophically at higher orders.
+   * Coefficients are converted to the monomial basis only when the solution
+   * is reported.
+   */
+  class PolynomialBasis {
+    public:
+      PolynomialBasis(
+          const Basis basis,
+          const size_t polynomial_order);
+
+      Basis Type() const {
+        return this->basis_;
+      }
+
+      // Writes derivative derivative_order of every basis function at tau
+      // into a caller-provided buffer of polynomial_order + 1 elements. For
+      // the monomial basis, this is the time vector.
+      void TimeVector(
+          const size_t derivative_order,
+          const double tau,
+          double* values) const;
+
+      // Writes the integral over tau in [0, 1] of the outer product of
+      // derivative derivative_order of the basis functions. Column-major,
+      // (polynomial_order + 1)^2 elements.
+      void QuadraticMatrix(
+          const size_t derivative_order,
+          double* quadratic_matrix) const;
+
+      // Writes the matrix that maps the coefficients of a polynomial onto
+      // the Bernstein control points of its derivative derivative_order.
+      // Row-major, polynomial_order - derivative_order + 1 rows of
+      // polynomial_order + 1 elements. By the convex hull property, the
+      // derivative lies between its smallest and largest control points
+      // over tau in [0, 1]. A polynomial of lower order uses the leading
+      // columns; its control points are those of its degree elevation.
+      void ControlPointMatrix(
+          const size_t derivative_order,
+          double* control_point_matrix) const;
+
+      // Converts the num_coefficients coefficients of a polynomial in this
+      // basis into its monomial coefficients. A polynomial of lower order
+      // than the basis uses the leading basis functions. The buffers must not
+      // alias.
+      void ToMonomial(
+          const double* coefficients,
+          const size_t num_coefficients,
+          double* monomial_coefficients) const;
+
+    private:
+      Basis basis_;
+      size_t num_params_;
+
+      // Monomial coefficients of every basis function. Row-major, row k
+      // holds the coefficient of 1/k! tau^k.
+      double to_monomial_[(kMaxPolynomialOrder + 1) * (kMaxPolynomialOrder + 1)];
+  };
+}
@@ -2,8 +2,11 @@
 
 #pragma once
 
+#include <string>
+
 #include <osqp.h>
 #include <Eigen/Dense>
+#include <Eigen/Sparse>
 
 namespace p4 {
   // Example:
@@ -97,4 +100,282 @@ namespace p4 {
         mapping(mapping_),
         value(value_) {}
   }; 
+
+  // Constraint: lower <= d^n x_i <= upper over a whole segment, for a single
+  // dimension i. Generates one two-sided row per sample point that only
+  // touches the coefficients of that dimension. Use INFTY for a one-sided
+  // bound.
+  // Example:
+  // Given a 3D problem (XYZ), the y-vel of the 3rd segment can be limited to
+  // +-2 as follows:
+  //   SegmentBoxBound(1,2,1,-2,+2)
+  //
+  struct SegmentBoxBound {
+    static constexpr c_float INFTY = OSQP_INFTY;
+
+    // The dimension being constrained. If a path has four dimensions
+    // (x,y,z,yaw), then 0 = x, 1 = y, etc.
+    const size_t dimension_idx;
+    // The index of the segment being constrained.
+    const size_t segment_idx;
+    // The index of the derivative being constraints. 0 = position, 1 =
+    // velocity, etc.
+    const size_t derivative_idx;
+    // The values that bound the derivative.
+    const double lower, upper;
+
+    SegmentBoxBound(
+      const size_t dimension_idx_,
+      const size_t segment_idx_,
+      const size_t derivative_idx_,
+      const double lower_,
+      const double upper_)
+      : dimension_idx(dimension_idx_),
+        segment_idx(segment_idx_),
+        derivative_idx(derivative_idx_),
+        lower(lower_),
+        upper(upper_) {}
+  };
+
+  // Constraint: A d^n x < b over a whole segment, for a polytope given in
+  // H-representation. Every row of A is a face, with one column per
+  // dimension. Faces are stored sparsely; a face only touches the
+  // coefficients of the dimensions it has entries for. Equivalent to one
+  // SegmentInequalityBound per face.
+  // Example:
+  // Given a 2D problem (XY), the position of the 3rd segment can be kept
+  // inside the unit diamond as follows:
+  //   Eigen::MatrixXd A(4,2);
+  //   A << 1, 1, 1, -1, -1, 1, -1, -1;
+  //   SegmentPolytopeBound(2,0,A,Eigen::Vector4d(1,1,1,1))
+  //
+  struct SegmentPolytopeBound {
+    static constexpr c_float INFTY = OSQP_INFTY;
+
+    // The index of the segment being constrained.
+    const size_t segment_idx;
+    // The index of the derivative being constraints. 0 = position, 1 =
+    // velocity, etc.
+    const size_t derivative_idx;
+    // Faces of the polytope, one per row. Row-major, so the entries of a
+    // face are contiguous.
+    Eigen::SparseMatrix<double, Eigen::RowMajor> faces;
+    // The value that every face takes.
+    Eigen::VectorXd offsets;
+
+    SegmentPolytopeBound(
+      const size_t segment_idx_,
+      const size_t derivative_idx_,
+      const Eigen::MatrixXd& faces_,
+      const Eigen::VectorXd& offsets_)
+      :
+        segment_idx(segment_idx_),
+        derivative_idx(derivative_idx_),
+        faces(faces_.sparseView()),
+        offsets(offsets_) {
+      this->faces.makeCompressed();
+    }
+
+    SegmentPolytopeBound(
+      const size_t segment_idx_,
+      const size_t derivative_idx_,
+      const Eigen::SparseMatrix<double, Eigen::RowMajor>& faces_,
+      const Eigen::VectorXd& offsets_)
+      :
+        segment_idx(segment_idx_),
+        derivative_idx(derivative_idx_),
+        faces(faces_),
+        offsets(offsets_) {
+      this->faces.makeCompressed();
+    }
+  };
+
+  // Constraint: lower <= d^n x_i <= upper at every node in [node_begin,
+  // node_end), for a single dimension i or for every dimension. Equivalent to
+  // one NodeInequalityBound per node and dimension, but expanded during
+  // assembly, so covering a range of nodes costs a single descriptor. A
+  // bound with lower == upper is an equality. Use INFTY for a one-sided
+  // bound. Nodes and dimensions outside of the problem are ignored.
+  // Example:
+  // Given a 3D problem (XYZ), the velocity of every dimension can be limited
+  // to +-2 at every node as follows:
+  //   NodeRangeBound(NodeRangeBound::ALL,0,NodeRangeBound::END,1,-2,+2)
+  //
+  struct NodeRangeBound {
+    static constexpr c_float INFTY = OSQP_INFTY;
+    // Dimension index covering every dimension
+    static constexpr size_t ALL = static_cast<size_t>(-1);
+    // Node index one past the final node
+    static constexpr size_t END = static_cast<size_t>(-1);
+
+    // The dimension being constrained, or ALL.
+    const size_t dimension_idx;
+    // The range of nodes being constrained. node_end is exclusive and may be
+    // END.
+    const size_t node_begin, node_end;
+    // The index of the derivative being constraints. 0 = position, 1 =
+    // velocity, etc.
+    const size_t derivative_idx;
+    // The values that bound the derivative.
+    const double lower, upper;
+
+    NodeRangeBound(
+      const size_t dimension_idx_,
+      const size_t node_begin_,
+      const size_t node_end_,
+      const size_t derivative_idx_,
+      const double lower_,
+      const double upper_)
+      : dimension_idx(dimension_idx_),
+        node_begin(node_begin_),
+        node_end(node_end_),
+        derivative_idx(derivative_idx_),
+        lower(lower_),
+        upper(upper_) {}
+  };
+
+  // Constraint: d^n x_i = values(i - dimension_begin, j - node_begin) for
+  // every dimension i and node j covered by a matrix of values. Rows are
+  // dimensions and columns are nodes, so the waypoints of a path can be
+  // pinned with a single bound. Equivalent to one NodeEqualityBound per
+  // entry. Entries outside of the problem are ignored.
+  // Example:
+  // Given a 3D problem (XYZ) and a 3-by-N matrix W of waypoint positions, the
+  // positions of the first N nodes can be fixed as follows:
+  //   NodeValuesBound(0,0,0,W)
+  //
+  struct NodeValuesBound {
+    // The first dimension being constrained.
+    const size_t dimension_begin;
+    // The first node being constrained.
+    const size_t node_begin;
+    // The index of the derivative being constraints. 0 = position, 1 =
+    // velocity, etc.
+    const size_t derivative_idx;
+    // The values that the constraints take. One row per dimension, one
+    // column per node.
+    Eigen::MatrixXd values;
+
+    NodeValuesBound(
+      const size_t dimension_begin_,
+      const size_t node_begin_,
+      const size_t derivative_idx_,
+      const Eigen::MatrixXd& values_)
+      : dimension_begin(dimension_begin_),
+        node_begin(node_begin_),
+        derivative_idx(derivative_idx_),
+        values(values_) {}
+  };
+
+  // Constraint: lower <= d^n x_i <= upper over every segment in
+  // [segment_begin, segment_end), for a single dimension i or for every
+  // dimension. Equivalent to one SegmentBoxBound per segment and dimension,
+  // but expanded during assembly. Segments and dimensions outside of the
+  // problem are ignored.
+  // Example:
+  // Given a 3D problem (XYZ), the velocity of every dimension can be limited
+  // to +-2 over the whole path as follows:
+  //   SegmentRangeBound(SegmentRangeBound::ALL,0,SegmentRangeBound::END,1,-2,+2)
+  //
+  struct SegmentRangeBound {
+    static constexpr c_float INFTY = OSQP_INFTY;
+    // Dimension index covering every dimension
+    static constexpr size_t ALL = static_cast<size_t>(-1);
+    // Segment index one past the final segment
+    static constexpr size_t END = static_cast<size_t>(-1);
+
+    // The dimension being constrained, or ALL.
+    const size_t dimension_idx;
+    // The range of segments being constrained. segment_end is exclusive and
+    // may be END.
+    const size_t segment_begin, segment_end;
+    // The index of the derivative being constraints. 0 = position, 1 =
+    // velocity, etc.
+    const size_t derivative_idx;
+    // The values that bound the derivative.
+    const double lower, upper;
+
+    SegmentRangeBound(
+      const size_t dimension_idx_,
+      const size_t segment_begin_,
+      const size_t segment_end_,
+      const size_t derivative_idx_,
+      const double lower_,
+      const double upper_)
+      : dimension_idx(dimension_idx_),
+        segment_begin(segment_begin_),
+        segment_end(segment_end_),
+        derivative_idx(derivative_idx_),
+        lower(lower_),
+        upper(upper_) {}
+  };
+
+  // Contradiction found by the bound pre-check of PolynomialSolver
+  enum class BoundConflict {
+    // No contradiction was found. The problem may still be infeasible.
+    NONE,
+    // The times are not strictly increasing at node_idx
+    NON_INCREASING_TIMES,
+    // An explicit bound refers to a dimension, node, segment or derivative
+    // outside of the problem. Range and values bounds are clamped instead.
+    INDEX_OUT_OF_RANGE,
+    // The node bounds on a derivative of a node admit no value
+    EMPTY_NODE_INTERVAL,
+    // The node bounds at an endpoint of a segment violate a bound on the
+    // segment
+    ENDPOINT_CONFLICT,
+    // A two-sided segment bound has a lower value above its upper value
+    EMPTY_SEGMENT_INTERVAL
+  };
+
+  // Result of the bound pre-check. Describes the first contradiction found.
+  struct BoundDiagnostic {
+    // Index that does not apply to a conflict
+    static constexpr size_t NO_INDEX = static_cast<size_t>(-1);
+
+    BoundConflict conflict = BoundConflict::NONE;
+    // Location of the conflict
+    size_t dimension_idx = NO_INDEX;
+    size_t node_idx = NO_INDEX;
+    size_t segment_idx = NO_INDEX;
+    size_t derivative_idx = NO_INDEX;
+    // Index of the offending bound in the vector named by the message
+    size_t bound_idx = NO_INDEX;
+    // Human-readable description
+    std::string message;
+
+    bool Ok() const {
+      return BoundConflict::NONE == this->conflict;
+    }
+  };
+
+  // Fixed-size counterpart of SegmentInequalityBound for use with
+  // PolynomialSolverT. The mapping is stored inline, so constructing a bound
+  // does not allocate. The mapping is unaligned so that bounds may be stored
+  // in a std::vector without an aligned allocator.
+  template <size_t Dims>
+  struct SegmentInequalityBoundT {
+    static constexpr c_float INFTY = OSQP_INFTY;
+
+    // The index of the node being constrained.
+    const size_t segment_idx;
+    // The index of the derivative being constraints. 0 = position, 1 =
+    // velocity, etc.
+    const size_t derivative_idx;
+    // A mapping that from N-to-scalar
+    Eigen::Matrix<double, Dims, 1, Eigen::DontAlign> mapping;
+    // The value that the constraint takes.
+    const double value;
+  
+    SegmentInequalityBoundT(
+      const size_t segment_idx_,
+      const size_t derivative_idx_,
+      const Eigen::Matrix<double, Dims, 1, Eigen::DontAlign>& mapping_,
+      const double value_)
+      :
+        segment_idx(segment_idx_),
+        derivative_idx(derivative_idx_),
+        mapping(mapping_),
+        value(value_) {}
+  }; 
 }
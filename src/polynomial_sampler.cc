@@ -16,7 +16,6 @@ namespace p4 {
     // Helper constants
     const size_t num_dimensions = solution.num_dimensions;
     const size_t num_nodes = solution.num_nodes;
-    const size_t polynomial_order = solution.polynomial_order;
     const size_t num_samples 
       = static_cast<size_t>((times.back() - times.front()) * this->options_.frequency);
 
@@ -46,8 +45,9 @@ namespace p4 {
 
         const Eigen::VectorXd polynomial_coefficients 
           = coefficients[dimension_idx][node_idx];
+        // Segments may have different polynomial orders
         const Eigen::MatrixXd tau_vec
-          = TimeVector(polynomial_order, this->options_.derivative_order, tau);
+          = TimeVector(polynomial_coefficients.size() - 1, this->options_.derivative_order, tau);
 
         // Time is the first dimension. Shift the index down.
         samples(dimension_idx + 1, sample_idx) 
@@ -0,0 +1,71 @@
+// Author: Tucker Haydon
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "polynomial_sampler.h"
+#include "polynomial_solver_fixed.h"
+#include "common.h"
+
+namespace p4 {
+  // Fixed-size counterpart of PolynomialSampler for solutions of
+  // PolynomialSolverT. Segment coefficients are read once per segment into a
+  // fixed-size block, and every sample is a single fixed-size
+  // matrix-vector product. Sampling allocates only the returned matrix.
+  template <size_t Order, size_t Dims>
+  class PolynomialSamplerT {
+    public:
+      // Rows indicate the dimension, cols indicate the sample index. The first
+      // element in each column is the sample time.
+      typedef Eigen::Matrix<double, Dims + 1, Eigen::Dynamic> SampleMatrix;
+
+      PolynomialSamplerT(const PolynomialSampler::Options& options = PolynomialSampler::Options())
+        : options_(options) {}
+
+      SampleMatrix Run(
+          const std::vector<double>& times,
+          const typename PolynomialSolverT<Order, Dims>::Solution& solution) {
+        const size_t num_segments = times.size() - 1;
+        const size_t num_samples 
+          = static_cast<size_t>((times.back() - times.front()) * this->options_.frequency);
+
+        SampleMatrix samples(Dims + 1, num_samples);
+
+        size_t node_idx = 0;
+        typename PolynomialSolverT<Order, Dims>::CoefficientMatrix coefficients 
+          = solution.SegmentCoefficients(node_idx);
+
+        for(size_t sample_idx = 0; sample_idx < num_samples; ++sample_idx) {
+          const double path_time = times.front() + sample_idx / this->options_.frequency;
+
+          // Advance to the segment containing the sample
+          if(path_time > times[node_idx + 1] && node_idx + 1 < num_segments) {
+            while(path_time > times[node_idx + 1] && node_idx + 1 < num_segments) {
+              node_idx++;
+            }
+            coefficients = solution.SegmentCoefficients(node_idx);
+          }
+
+          const double alpha = times[node_idx+1] - times[node_idx];
+          const double tau = (path_time - times[node_idx]) / alpha;
+          const Eigen::Matrix<double, Order + 1, 1> tau_vec 
+            = TimeVectorT<Order>(this->options_.derivative_order, tau);
+
+          // Time is the first dimension
+          samples(0, sample_idx) = path_time;
+          samples.template bottomRows<Dims>().col(sample_idx) 
+            = coefficients.transpose() * tau_vec 
+            / std::pow(alpha, this->options_.derivative_order);
+        }
+
+        return samples;
+      }
+
+    private:
+      PolynomialSampler::Options options_;
+  };
+}
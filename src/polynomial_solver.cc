@@ -1,15 +1,24 @@
 // Author: Tucker Haydon
 
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
+#include <sstream>
+#include <thread>
+#include <utility>
 #include <cstdlib>
 #include <vector>
 
 #include <Eigen/Dense>
-#include <Eigen/Sparse>
 #include <osqp.h>
 
 #include "polynomial_solver.h"
 #include "common.h"
+#include "thread_pool.h"
+#include "presolve.h"
+#include "direct_solver.h"
+#include "node_derivative_map.h"
+#include "workspace_cache.h"
 
 namespace p4 {
   namespace {
@@ -20,322 +29,3144 @@ namespace p4 {
       size_t derivative_order;
       size_t continuity_order;
       size_t num_intermediate_points;
+      // Continuity constraints between neighbouring segments, per dimension
+      size_t num_continuity_constraints;
       size_t num_nodes;
       size_t num_segments;
-      size_t num_params_per_node_per_dim;
+      // Coefficients of the highest-order polynomial. The polynomial of a
+      // dimension and segment may have fewer; see VariableLayout.
       size_t num_params_per_segment_per_dim;
-      size_t num_params_per_node;
-      size_t num_params_per_segment;
       size_t total_num_params;
       size_t num_constraints;
+      VariableLayout layout;
+      SegmentBoundPoints segment_bound_points;
     };
 
-    // Generates a square matrix that is the integrated form of d^n/dt^n [p(x)'p(x)].
-    // The derivative of this matrix can be easily calculated by computing the
-    // zeroth derivative of the matrix, padding the first n rows and columns
-    // with zeros, and shifting the matrix down and to the right by n
-    // rows/columns.
+    // Number of points at which a segment bound on a derivative is enforced.
+    // A bound has a row per point, and a polytope bound a row per point and
+    // face.
+    size_t NumBoundPoints(
+        const Constants& constants,
+        const size_t derivative_idx) {
+      if(SegmentBoundPoints::BERNSTEIN == constants.segment_bound_points) {
+        return derivative_idx <= constants.polynomial_order 
+          ? constants.polynomial_order - derivative_idx + 1 
+          : 0;
+      }
+      // Add 2 for start and end points
+      return constants.num_intermediate_points + 2;
+    }
+
+    // Per-run cache of time vectors in the basis of the problem. Holds the
+    // time vector of every derivative at every segment sample point, and at
+    // the end of a segment (tau = 1) for the continuity constraints and the
+    // final node bounds. Assembly reads rows from the cache instead of
+    // recomputing them for every constraint. With Bernstein segment bounds,
+    // also holds the control point rows of every derivative.
+    //
+    // Sample points include the start- and end-points of the segment. When
+    // constraining a segment, also constrain the endpoints of the segment to
+    // the same value. If this were not the case, the following situation
+    // could occur: the start endpoint is constrained to -2, but the following
+    // segment is constrained above zero. Clearly, there is no smooth solution
+    // that permits this. 
+    class TimeVectorCache {
+      public:
+        TimeVectorCache(
+            const Constants& constants,
+            const PolynomialBasis& basis,
+            Arena& arena)
+          : num_params_(constants.num_params_per_segment_per_dim),
+            // Add 2 for start and end points
+            num_points_(constants.num_intermediate_points + 2) {
+          // Add two to account for the endpoints and then remove one to
+          // convert from the number of points the the number of segments.
+          // Divide the segment length (1) by the number of segments to get
+          // the length of each intermediate segment.
+          const double dt = 1.0 / (num_points_ - 1);
+
+          sample_rows_ = arena.Allocate<double>(num_params_ * num_points_ * num_params_);
+          terminal_rows_ = arena.Allocate<double>(num_params_ * num_params_);
+          for(size_t derivative_idx = 0; derivative_idx < num_params_; ++derivative_idx) {
+            for(size_t point_idx = 0; point_idx < num_points_; ++point_idx) {
+              basis.TimeVector(
+                  derivative_idx, 
+                  point_idx * dt, 
+                  sample_rows_ + (derivative_idx * num_points_ + point_idx) * num_params_);
+            }
+            basis.TimeVector(
+                derivative_idx, 
+                1.0, 
+                terminal_rows_ + derivative_idx * num_params_);
+          }
+
+          control_rows_ = nullptr;
+          if(SegmentBoundPoints::BERNSTEIN == constants.segment_bound_points) {
+            control_rows_ = arena.Allocate<double>(num_params_ * num_params_ * num_params_);
+            for(size_t derivative_idx = 0; derivative_idx < num_params_; ++derivative_idx) {
+              basis.ControlPointMatrix(
+                  derivative_idx, 
+                  control_rows_ + derivative_idx * num_params_ * num_params_);
+            }
+          }
+        }
+
+        // Time vector of a derivative at a segment sample point
+        const double* SampleRow(
+            const size_t derivative_idx, 
+            const size_t point_idx) const {
+          return sample_rows_ + (derivative_idx * num_points_ + point_idx) * num_params_;
+        }
+
+        // Time vector of a derivative at the start of a segment
+        const double* StartRow(const size_t derivative_idx) const {
+          return this->SampleRow(derivative_idx, 0);
+        }
+
+        // Time vector of a derivative at the end of a segment
+        const double* TerminalRow(const size_t derivative_idx) const {
+          return terminal_rows_ + derivative_idx * num_params_;
+        }
+
+        // Row of a segment bound on a derivative at one of its points. See
+        // NumBoundPoints.
+        const double* BoundRow(
+            const size_t derivative_idx, 
+            const size_t point_idx) const {
+          if(nullptr != control_rows_) {
+            return control_rows_ + (derivative_idx * num_params_ + point_idx) * num_params_;
+          }
+          return this->SampleRow(derivative_idx, point_idx);
+        }
+
+      private:
+        size_t num_params_;
+        size_t num_points_;
+        double* sample_rows_;
+        double* terminal_rows_;
+        double* control_rows_;
+    };
+
+    // Buckets node bounds by (dimension, node, derivative) so that assembly
+    // can visit the bounds applied to a single key without rescanning every
+    // bound. Built with a counting sort; bounds within a bucket keep their
+    // input order, preserving the constraint row ordering. Bounds whose
+    // indices fall outside of the problem are not indexed.
+    template <class Bound>
+    class NodeBoundIndex {
+      public:
+        NodeBoundIndex(
+            const Constants& constants,
+            const std::vector<Bound>& bounds,
+            Arena& arena)
+          : num_nodes_(constants.num_nodes),
+            num_derivatives_(constants.num_params_per_segment_per_dim) {
+          const size_t num_keys = constants.num_dimensions * num_nodes_ * num_derivatives_;
+          offsets_ = arena.Allocate<size_t>(num_keys + 1);
+          std::fill(offsets_, offsets_ + num_keys + 1, 0);
+
+          for(const Bound& bound: bounds) {
+            if(true == this->InRange(constants, bound)) {
+              offsets_[this->Key(bound.dimension_idx, bound.node_idx, bound.derivative_idx) + 1]++;
+            }
+          }
+
+          for(size_t key = 0; key < num_keys; ++key) {
+            offsets_[key + 1] += offsets_[key];
+          }
+
+          size_t* cursor = arena.Allocate<size_t>(num_keys);
+          std::copy(offsets_, offsets_ + num_keys, cursor);
+          bound_indices_ = arena.Allocate<size_t>(offsets_[num_keys]);
+          for(size_t bound_idx = 0; bound_idx < bounds.size(); ++bound_idx) {
+            const Bound& bound = bounds[bound_idx];
+            if(true == this->InRange(constants, bound)) {
+              bound_indices_[cursor[this->Key(bound.dimension_idx, bound.node_idx, bound.derivative_idx)]++] = bound_idx;
+            }
+          }
+        }
+
+        // Indices into the bound vector of the bounds applied to a key
+        const size_t* Begin(
+            const size_t dimension_idx, 
+            const size_t node_idx, 
+            const size_t derivative_idx) const {
+          return bound_indices_ + offsets_[this->Key(dimension_idx, node_idx, derivative_idx)];
+        }
+
+        const size_t* End(
+            const size_t dimension_idx, 
+            const size_t node_idx, 
+            const size_t derivative_idx) const {
+          return bound_indices_ + offsets_[this->Key(dimension_idx, node_idx, derivative_idx) + 1];
+        }
+
+      private:
+        size_t Key(
+            const size_t dimension_idx, 
+            const size_t node_idx, 
+            const size_t derivative_idx) const {
+          return (dimension_idx * num_nodes_ + node_idx) * num_derivatives_ + derivative_idx;
+        }
+
+        // Derivatives above the order of a segment are indexed; their rows
+        // hold no coefficients. The bound pre-check reports those that
+        // exclude zero.
+        static bool InRange(const Constants& constants, const Bound& bound) {
+          return 
+            bound.dimension_idx < constants.num_dimensions &&
+            bound.node_idx < constants.num_nodes &&
+            bound.derivative_idx < constants.num_params_per_segment_per_dim;
+        }
+
+        size_t num_nodes_;
+        size_t num_derivatives_;
+        size_t* offsets_;
+        size_t* bound_indices_;
+    };
+
+    // Whether a segment bound applies to a segment, dimension and derivative
+    // of the problem
+    bool InRange(const Constants& constants, const SegmentBoundView& bound) {
+      return 
+        bound.segment_idx < constants.num_segments &&
+        bound.derivative_idx < constants.num_params_per_segment_per_dim &&
+        bound.mapping_size >= constants.num_dimensions;
+    }
+
+    bool InRange(const Constants& constants, const SegmentBoxBound& bound) {
+      return 
+        bound.segment_idx < constants.num_segments &&
+        bound.dimension_idx < constants.num_dimensions &&
+        bound.derivative_idx < constants.num_params_per_segment_per_dim;
+    }
+
+    bool InRange(const Constants& constants, const SegmentPolytopeBound& bound) {
+      return 
+        bound.segment_idx < constants.num_segments &&
+        bound.derivative_idx < constants.num_params_per_segment_per_dim;
+    }
+
+    // Number of rows of a segment bound. Bounds outside of the problem have
+    // none, and are skipped by assembly.
+    size_t NumBoundRows(const Constants& constants, const SegmentBoundView& bound) {
+      return true == InRange(constants, bound) ? NumBoundPoints(constants, bound.derivative_idx) : 0;
+    }
+
+    size_t NumBoundRows(const Constants& constants, const SegmentBoxBound& bound) {
+      return true == InRange(constants, bound) ? NumBoundPoints(constants, bound.derivative_idx) : 0;
+    }
+
+    size_t NumBoundRows(const Constants& constants, const SegmentPolytopeBound& bound) {
+      return true == InRange(constants, bound) 
+        ? bound.faces.rows() * NumBoundPoints(constants, bound.derivative_idx) 
+        : 0;
+    }
+
+    // Half-open range of indices covered by a range bound
+    struct IndexRange {
+      size_t begin;
+      size_t end;
+
+      size_t Size() const {
+        return this->end - this->begin;
+      }
+
+      bool Contains(const size_t idx) const {
+        return idx >= this->begin && idx < this->end;
+      }
+    };
+
+    // Clamps [begin, end) to [0, size)
+    IndexRange ClampRange(
+        const size_t begin,
+        const size_t end,
+        const size_t size) {
+      IndexRange range;
+      range.end = std::min(end, size);
+      range.begin = std::min(begin, range.end);
+      return range;
+    }
+
+    // Dimensions covered by a dimension index that may stand for every
+    // dimension
+    IndexRange DimensionRange(
+        const Constants& constants,
+        const size_t dimension_idx,
+        const size_t all) {
+      if(all == dimension_idx) {
+        return ClampRange(0, constants.num_dimensions, constants.num_dimensions);
+      }
+      return ClampRange(dimension_idx, dimension_idx + 1, constants.num_dimensions);
+    }
+
+    // Dimensions and nodes or segments of the problem covered by a range
+    // bound. Both ranges are empty when the bounded derivative falls outside
+    // of the problem.
+    void CoveredRanges(
+        const Constants& constants,
+        const NodeRangeBound& bound,
+        IndexRange& dimensions,
+        IndexRange& nodes) {
+      const size_t num_nodes 
+        = bound.derivative_idx < constants.num_params_per_segment_per_dim ? constants.num_nodes : 0;
+      dimensions = DimensionRange(constants, bound.dimension_idx, NodeRangeBound::ALL);
+      nodes = ClampRange(bound.node_begin, bound.node_end, num_nodes);
+      if(0 == nodes.Size()) {
+        dimensions.end = dimensions.begin;
+      }
+    }
+
+    void CoveredRanges(
+        const Constants& constants,
+        const NodeValuesBound& bound,
+        IndexRange& dimensions,
+        IndexRange& nodes) {
+      const size_t num_nodes 
+        = bound.derivative_idx < constants.num_params_per_segment_per_dim ? constants.num_nodes : 0;
+      dimensions = ClampRange(
+          bound.dimension_begin, 
+          bound.dimension_begin + bound.values.rows(), 
+          constants.num_dimensions);
+      nodes = ClampRange(bound.node_begin, bound.node_begin + bound.values.cols(), num_nodes);
+      if(0 == nodes.Size()) {
+        dimensions.end = dimensions.begin;
+      }
+    }
+
+    void CoveredRanges(
+        const Constants& constants,
+        const SegmentRangeBound& bound,
+        IndexRange& dimensions,
+        IndexRange& segments) {
+      const size_t num_segments 
+        = bound.derivative_idx < constants.num_params_per_segment_per_dim ? constants.num_segments : 0;
+      dimensions = DimensionRange(constants, bound.dimension_idx, SegmentRangeBound::ALL);
+      segments = ClampRange(bound.segment_begin, bound.segment_end, num_segments);
+      if(0 == segments.Size()) {
+        dimensions.end = dimensions.begin;
+      }
+    }
+
+    // Number of (dimension, node) or (dimension, segment) pairs covered by a
+    // range bound
+    template <class Bound>
+    size_t NumCovered(
+        const Constants& constants,
+        const Bound& bound) {
+      IndexRange dimensions, indices;
+      CoveredRanges(constants, bound, dimensions, indices);
+      return dimensions.Size() * indices.Size();
+    }
+
+    // Buckets node range or values bounds by every (dimension, node,
+    // derivative) they cover, like NodeBoundIndex. A bound is listed once per
+    // covered pair, so assembly visits the bounds of a key without rescanning
+    // every bound. Bounds within a bucket keep their input order.
+    template <class Bound>
+    class NodeRangeIndex {
+      public:
+        NodeRangeIndex(
+            const Constants& constants,
+            const std::vector<Bound>& bounds,
+            Arena& arena)
+          : num_nodes_(constants.num_nodes),
+            num_derivatives_(constants.num_params_per_segment_per_dim) {
+          const size_t num_keys = constants.num_dimensions * num_nodes_ * num_derivatives_;
+          offsets_ = arena.Allocate<size_t>(num_keys + 1);
+          std::fill(offsets_, offsets_ + num_keys + 1, 0);
+
+          for(const Bound& bound: bounds) {
+            IndexRange dimensions, nodes;
+            CoveredRanges(constants, bound, dimensions, nodes);
+            for(size_t dimension_idx = dimensions.begin; dimension_idx < dimensions.end; ++dimension_idx) {
+              for(size_t node_idx = nodes.begin; node_idx < nodes.end; ++node_idx) {
+                offsets_[this->Key(dimension_idx, node_idx, bound.derivative_idx) + 1]++;
+              }
+            }
+          }
+
+          for(size_t key = 0; key < num_keys; ++key) {
+            offsets_[key + 1] += offsets_[key];
+          }
+
+          size_t* cursor = arena.Allocate<size_t>(num_keys);
+          std::copy(offsets_, offsets_ + num_keys, cursor);
+          bound_indices_ = arena.Allocate<size_t>(offsets_[num_keys]);
+          for(size_t bound_idx = 0; bound_idx < bounds.size(); ++bound_idx) {
+            const Bound& bound = bounds[bound_idx];
+            IndexRange dimensions, nodes;
+            CoveredRanges(constants, bound, dimensions, nodes);
+            for(size_t dimension_idx = dimensions.begin; dimension_idx < dimensions.end; ++dimension_idx) {
+              for(size_t node_idx = nodes.begin; node_idx < nodes.end; ++node_idx) {
+                bound_indices_[cursor[this->Key(dimension_idx, node_idx, bound.derivative_idx)]++] = bound_idx;
+              }
+            }
+          }
+        }
+
+        // Indices into the bound vector of the bounds covering a key
+        const size_t* Begin(
+            const size_t dimension_idx, 
+            const size_t node_idx, 
+            const size_t derivative_idx) const {
+          return bound_indices_ + offsets_[this->Key(dimension_idx, node_idx, derivative_idx)];
+        }
+
+        const size_t* End(
+            const size_t dimension_idx, 
+            const size_t node_idx, 
+            const size_t derivative_idx) const {
+          return bound_indices_ + offsets_[this->Key(dimension_idx, node_idx, derivative_idx) + 1];
+        }
+
+      private:
+        size_t Key(
+            const size_t dimension_idx, 
+            const size_t node_idx, 
+            const size_t derivative_idx) const {
+          return (dimension_idx * num_nodes_ + node_idx) * num_derivatives_ + derivative_idx;
+        }
+
+        size_t num_nodes_;
+        size_t num_derivatives_;
+        size_t* offsets_;
+        size_t* bound_indices_;
+    };
+
+    // Buckets segment bounds by segment so that assembly can visit the
+    // bounds applied to a range of segments. Bounds within a bucket keep
+    // their input order. Bounds that fall outside of the problem are not
+    // indexed.
+    template <class Bound>
+    class SegmentBoundIndex {
+      public:
+        SegmentBoundIndex(
+            const Constants& constants,
+            const Bound* bounds,
+            const size_t num_bounds,
+            Arena& arena)
+          : num_segments_(constants.num_segments) {
+          offsets_ = arena.Allocate<size_t>(num_segments_ + 1);
+          std::fill(offsets_, offsets_ + num_segments_ + 1, 0);
+
+          for(size_t bound_idx = 0; bound_idx < num_bounds; ++bound_idx) {
+            if(true == InRange(constants, bounds[bound_idx])) {
+              offsets_[bounds[bound_idx].segment_idx + 1]++;
+            }
+          }
+
+          for(size_t segment_idx = 0; segment_idx < num_segments_; ++segment_idx) {
+            offsets_[segment_idx + 1] += offsets_[segment_idx];
+          }
+
+          size_t* cursor = arena.Allocate<size_t>(num_segments_);
+          std::copy(offsets_, offsets_ + num_segments_, cursor);
+          bound_indices_ = arena.Allocate<size_t>(offsets_[num_segments_]);
+          for(size_t bound_idx = 0; bound_idx < num_bounds; ++bound_idx) {
+            if(true == InRange(constants, bounds[bound_idx])) {
+              bound_indices_[cursor[bounds[bound_idx].segment_idx]++] = bound_idx;
+            }
+          }
+        }
+
+        // Indices into the bound array of the bounds applied to a segment
+        const size_t* Begin(const size_t segment_idx) const {
+          return bound_indices_ + offsets_[segment_idx];
+        }
+
+        const size_t* End(const size_t segment_idx) const {
+          return bound_indices_ + offsets_[segment_idx + 1];
+        }
+
+      private:
+        size_t num_segments_;
+        size_t* offsets_;
+        size_t* bound_indices_;
+    };
+
+    // Scales a bound into tau units. Infinite bounds stay infinite.
+    double ScaleBound(
+        const double value,
+        const double scale) {
+      if(value >= OSQP_INFTY || value <= -OSQP_INFTY) {
+        return value;
+      }
+      return value * scale;
+    }
+
+    // Largest magnitude of the entries of a row
+    double MaxAbs(
+        const double* row,
+        const size_t size) {
+      double max_abs = 0;
+      for(size_t idx = 0; idx < size; ++idx) {
+        max_abs = std::max(max_abs, std::abs(row[idx]));
+      }
+      return max_abs;
+    }
+
+    // Scale that brings the largest magnitude of a row to one. Empty rows are
+    // left as they are.
+    double RowScale(const double max_abs) {
+      return 0.0 < max_abs ? 1.0 / max_abs : 1.0;
+    }
+
+    // Relative tolerance of the bound pre-check. Bounds that contradict each
+    // other by less are attributed to rounding.
+    constexpr double kBoundCheckTolerance = 1e-9;
+
+    // Whether value exceeds upper by more than the tolerance
+    bool Exceeds(
+        const double value,
+        const double upper) {
+      const double scale = std::max(1.0, std::max(std::abs(value), std::abs(upper)));
+      return value - upper > kBoundCheckTolerance * scale;
+    }
+
+    // Whether a derivative of a dimension is identically zero where the
+    // node bounds of a node apply. Node bounds apply to the polynomial of
+    // the segment that starts at the node, or that ends at the final node,
+    // whose derivatives beyond its order vanish.
+    bool VanishesAtNode(
+        const Constants& constants,
+        const size_t dimension_idx,
+        const size_t node_idx,
+        const size_t derivative_idx) {
+      const size_t segment_idx = node_idx == constants.num_segments ? node_idx - 1 : node_idx;
+      return derivative_idx >= constants.layout.NumCoefficients(dimension_idx, segment_idx);
+    }
+
+    // Interval of every (dimension, node, derivative) admitted by the node
+    // bounds. Only derivatives below num_derivatives are tracked; the
+    // interval of any other derivative is unbounded. Derivatives that vanish
+    // at a node start out as zero.
+    class NodeIntervals {
+      public:
+        NodeIntervals(
+            const Constants& constants,
+            const size_t num_derivatives,
+            Arena& arena)
+          : num_nodes_(constants.num_nodes),
+            num_derivatives_(num_derivatives) {
+          const size_t num_keys = constants.num_dimensions * num_nodes_ * num_derivatives_;
+          lower_ = arena.Allocate<double>(num_keys);
+          upper_ = arena.Allocate<double>(num_keys);
+          std::fill(lower_, lower_ + num_keys, -OSQP_INFTY);
+          std::fill(upper_, upper_ + num_keys, OSQP_INFTY);
+          if(true == constants.layout.IsUniform()) {
+            return;
+          }
+          for(size_t dimension_idx = 0; dimension_idx < constants.num_dimensions; ++dimension_idx) {
+            for(size_t node_idx = 0; node_idx < num_nodes_; ++node_idx) {
+              for(size_t derivative_idx = 0; derivative_idx < num_derivatives_; ++derivative_idx) {
+                if(true == VanishesAtNode(constants, dimension_idx, node_idx, derivative_idx)) {
+                  const size_t key = this->Key(dimension_idx, node_idx, derivative_idx);
+                  lower_[key] = 0;
+                  upper_[key] = 0;
+                }
+              }
+            }
+          }
+        }
+
+        // Intersects the interval of a key with [lower, upper]. Returns false
+        // if the intersection is empty.
+        bool Intersect(
+            const size_t dimension_idx,
+            const size_t node_idx,
+            const size_t derivative_idx,
+            const double lower,
+            const double upper) {
+          const size_t key = this->Key(dimension_idx, node_idx, derivative_idx);
+          lower_[key] = std::max(lower_[key], lower);
+          upper_[key] = std::min(upper_[key], upper);
+          return false == Exceeds(lower_[key], upper_[key]);
+        }
+
+        double Lower(
+            const size_t dimension_idx,
+            const size_t node_idx,
+            const size_t derivative_idx) const {
+          return derivative_idx < num_derivatives_ 
+            ? lower_[this->Key(dimension_idx, node_idx, derivative_idx)] 
+            : -OSQP_INFTY;
+        }
+
+        double Upper(
+            const size_t dimension_idx,
+            const size_t node_idx,
+            const size_t derivative_idx) const {
+          return derivative_idx < num_derivatives_ 
+            ? upper_[this->Key(dimension_idx, node_idx, derivative_idx)] 
+            : OSQP_INFTY;
+        }
+
+      private:
+        size_t Key(
+            const size_t dimension_idx, 
+            const size_t node_idx, 
+            const size_t derivative_idx) const {
+          return (dimension_idx * num_nodes_ + node_idx) * num_derivatives_ + derivative_idx;
+        }
+
+        size_t num_nodes_;
+        size_t num_derivatives_;
+        double* lower_;
+        double* upper_;
+    };
+
+    // Why a node bound left the interval of a derivative empty. A vanishing
+    // derivative starts out as zero, so the bound itself excludes zero.
+    const char* EmptyIntervalReason(
+        const Constants& constants,
+        const size_t dimension_idx,
+        const size_t node_idx,
+        const size_t derivative_idx,
+        const char* contradiction) {
+      return true == VanishesAtNode(constants, dimension_idx, node_idx, derivative_idx)
+        ? " excludes zero on a derivative above the polynomial order of the segment."
+        : contradiction;
+    }
+
+    // Builds the diagnostic of a conflict
+    BoundDiagnostic Conflict(
+        const BoundConflict conflict,
+        const size_t dimension_idx,
+        const size_t node_idx,
+        const size_t segment_idx,
+        const size_t derivative_idx,
+        const size_t bound_idx,
+        const std::string& message) {
+      BoundDiagnostic diagnostic;
+      diagnostic.conflict = conflict;
+      diagnostic.dimension_idx = dimension_idx;
+      diagnostic.node_idx = node_idx;
+      diagnostic.segment_idx = segment_idx;
+      diagnostic.derivative_idx = derivative_idx;
+      diagnostic.bound_idx = bound_idx;
+      diagnostic.message = message;
+      return diagnostic;
+    }
+
+    // Nodes at the endpoints of a segment whose bounds apply to a derivative
+    // of the segment. A node is bounded at the start of the segment that
+    // follows it, and at the end of the segment before it only if continuity
+    // carries the derivative across or the node is the final node.
+    size_t EndpointNodes(
+        const Constants& constants,
+        const size_t segment_idx,
+        const size_t derivative_idx,
+        size_t* node_indices) {
+      size_t num_nodes = 0;
+      node_indices[num_nodes++] = segment_idx;
+      if(derivative_idx <= constants.continuity_order || segment_idx + 1 == constants.num_segments) {
+        node_indices[num_nodes++] = segment_idx + 1;
+      }
+      return num_nodes;
+    }
+
+    // Adds the smallest value of coefficient times a derivative of a
+    // dimension over its node interval to minimum. Returns false if the
+    // term is unbounded below.
+    bool AddMinimum(
+        const NodeIntervals& intervals,
+        const size_t dimension_idx,
+        const size_t node_idx,
+        const size_t derivative_idx,
+        const double coefficient,
+        double& minimum) {
+      if(0.0 == coefficient) {
+        return true;
+      }
+      const double value = coefficient > 0
+        ? intervals.Lower(dimension_idx, node_idx, derivative_idx)
+        : intervals.Upper(dimension_idx, node_idx, derivative_idx);
+      if(value <= -OSQP_INFTY || value >= OSQP_INFTY) {
+        return false;
+      }
+      minimum += coefficient * value;
+      return true;
+    }
+
+    // Checks the values of the times and bounds on their own: times must
+    // increase and two-sided bounds must admit a value. Does not look at
+    // indices or at how bounds interact, so it needs no node intervals.
+    // Replans of a problem only change values and are checked with this
+    // alone.
+    BoundDiagnostic CheckBoundValues(
+        const Constants& constants,
+        const std::vector<double>& times,
+        const ProblemBounds& bounds) {
+      std::ostringstream message;
+      for(size_t node_idx = 1; node_idx < constants.num_nodes; ++node_idx) {
+        if(times[node_idx] <= times[node_idx - 1]) {
+          message << "Time of node " << node_idx << " does not exceed the time of the previous node.";
+          return Conflict(
+              BoundConflict::NON_INCREASING_TIMES, 
+              BoundDiagnostic::NO_INDEX, node_idx, BoundDiagnostic::NO_INDEX, BoundDiagnostic::NO_INDEX, 
+              BoundDiagnostic::NO_INDEX, message.str());
+        }
+      }
+
+      for(size_t bound_idx = 0; bound_idx < bounds.node_inequality_bounds.size(); ++bound_idx) {
+        const NodeInequalityBound& bound = bounds.node_inequality_bounds[bound_idx];
+        if(true == Exceeds(bound.lower, bound.upper)) {
+          message << "Node inequality bound " << bound_idx << " has a lower value above its upper value.";
+          return Conflict(
+              BoundConflict::EMPTY_NODE_INTERVAL, 
+              bound.dimension_idx, bound.node_idx, BoundDiagnostic::NO_INDEX, bound.derivative_idx, 
+              bound_idx, message.str());
+        }
+      }
+      for(size_t bound_idx = 0; bound_idx < bounds.node_range_bounds.size(); ++bound_idx) {
+        const NodeRangeBound& bound = bounds.node_range_bounds[bound_idx];
+        if(true == Exceeds(bound.lower, bound.upper)) {
+          message << "Node range bound " << bound_idx << " has a lower value above its upper value.";
+          return Conflict(
+              BoundConflict::EMPTY_NODE_INTERVAL, 
+              BoundDiagnostic::NO_INDEX, BoundDiagnostic::NO_INDEX, BoundDiagnostic::NO_INDEX, bound.derivative_idx, 
+              bound_idx, message.str());
+        }
+      }
+      for(size_t bound_idx = 0; bound_idx < bounds.segment_box_bounds.size(); ++bound_idx) {
+        const SegmentBoxBound& bound = bounds.segment_box_bounds[bound_idx];
+        if(true == Exceeds(bound.lower, bound.upper)) {
+          message << "Segment box bound " << bound_idx << " has a lower value above its upper value.";
+          return Conflict(
+              BoundConflict::EMPTY_SEGMENT_INTERVAL, 
+              bound.dimension_idx, BoundDiagnostic::NO_INDEX, bound.segment_idx, bound.derivative_idx, 
+              bound_idx, message.str());
+        }
+      }
+      for(size_t bound_idx = 0; bound_idx < bounds.segment_range_bounds.size(); ++bound_idx) {
+        const SegmentRangeBound& bound = bounds.segment_range_bounds[bound_idx];
+        if(true == Exceeds(bound.lower, bound.upper)) {
+          message << "Segment range bound " << bound_idx << " has a lower value above its upper value.";
+          return Conflict(
+              BoundConflict::EMPTY_SEGMENT_INTERVAL, 
+              BoundDiagnostic::NO_INDEX, BoundDiagnostic::NO_INDEX, BoundDiagnostic::NO_INDEX, bound.derivative_idx, 
+              bound_idx, message.str());
+        }
+      }
+
+      return BoundDiagnostic();
+    }
+
+    // Linear-time pre-check of the bounds of a problem. Catches the common
+    // contradictions: non-increasing times, explicit bounds outside of the
+    // problem, node and segment bounds that admit no value, and node bounds
+    // at the endpoint of a segment that violate a bound on the segment.
+    // Node intervals are allocated in the arena.
+    BoundDiagnostic CheckBounds(
+        const Constants& constants,
+        const std::vector<double>& times,
+        const ProblemBounds& bounds,
+        Arena& arena) {
+      const BoundDiagnostic value_diagnostic = CheckBoundValues(constants, times, bounds);
+      if(false == value_diagnostic.Ok()) {
+        return value_diagnostic;
+      }
+
+      std::ostringstream message;
+
+      /*
+       * INDICES
+       */
+      const size_t num_derivatives = constants.num_params_per_segment_per_dim;
+      size_t num_bounded_derivatives = 0;
+      for(size_t bound_idx = 0; bound_idx < bounds.node_equality_bounds.size(); ++bound_idx) {
+        const NodeEqualityBound& bound = bounds.node_equality_bounds[bound_idx];
+        if(bound.dimension_idx >= constants.num_dimensions 
+            || bound.node_idx >= constants.num_nodes 
+            || bound.derivative_idx >= num_derivatives) {
+          message << "Node equality bound " << bound_idx << " is outside of the problem.";
+          return Conflict(
+              BoundConflict::INDEX_OUT_OF_RANGE, 
+              bound.dimension_idx, bound.node_idx, BoundDiagnostic::NO_INDEX, bound.derivative_idx, 
+              bound_idx, message.str());
+        }
+        num_bounded_derivatives = std::max(num_bounded_derivatives, bound.derivative_idx + 1);
+      }
+      for(size_t bound_idx = 0; bound_idx < bounds.node_inequality_bounds.size(); ++bound_idx) {
+        const NodeInequalityBound& bound = bounds.node_inequality_bounds[bound_idx];
+        if(bound.dimension_idx >= constants.num_dimensions 
+            || bound.node_idx >= constants.num_nodes 
+            || bound.derivative_idx >= num_derivatives) {
+          message << "Node inequality bound " << bound_idx << " is outside of the problem.";
+          return Conflict(
+              BoundConflict::INDEX_OUT_OF_RANGE, 
+              bound.dimension_idx, bound.node_idx, BoundDiagnostic::NO_INDEX, bound.derivative_idx, 
+              bound_idx, message.str());
+        }
+        num_bounded_derivatives = std::max(num_bounded_derivatives, bound.derivative_idx + 1);
+      }
+      for(const NodeRangeBound& bound: bounds.node_range_bounds) {
+        if(0 != NumCovered(constants, bound)) {
+          num_bounded_derivatives = std::max(num_bounded_derivatives, bound.derivative_idx + 1);
+        }
+      }
+      for(const NodeValuesBound& bound: bounds.node_values_bounds) {
+        if(0 != NumCovered(constants, bound)) {
+          num_bounded_derivatives = std::max(num_bounded_derivatives, bound.derivative_idx + 1);
+        }
+      }
+
+      for(size_t bound_idx = 0; bound_idx < bounds.num_segment_inequality_bounds; ++bound_idx) {
+        const SegmentBoundView& bound = bounds.segment_inequality_bounds[bound_idx];
+        if(false == InRange(constants, bound)) {
+          message << "Segment inequality bound " << bound_idx << " is outside of the problem.";
+          return Conflict(
+              BoundConflict::INDEX_OUT_OF_RANGE, 
+              BoundDiagnostic::NO_INDEX, BoundDiagnostic::NO_INDEX, bound.segment_idx, bound.derivative_idx, 
+              bound_idx, message.str());
+        }
+      }
+      for(size_t bound_idx = 0; bound_idx < bounds.segment_box_bounds.size(); ++bound_idx) {
+        const SegmentBoxBound& bound = bounds.segment_box_bounds[bound_idx];
+        if(false == InRange(constants, bound)) {
+          message << "Segment box bound " << bound_idx << " is outside of the problem.";
+          return Conflict(
+              BoundConflict::INDEX_OUT_OF_RANGE, 
+              bound.dimension_idx, BoundDiagnostic::NO_INDEX, bound.segment_idx, bound.derivative_idx, 
+              bound_idx, message.str());
+        }
+      }
+      for(size_t bound_idx = 0; bound_idx < bounds.segment_polytope_bounds.size(); ++bound_idx) {
+        const SegmentPolytopeBound& bound = bounds.segment_polytope_bounds[bound_idx];
+        if(false == InRange(constants, bound)) {
+          message << "Segment polytope bound " << bound_idx << " is outside of the problem.";
+          return Conflict(
+              BoundConflict::INDEX_OUT_OF_RANGE, 
+              BoundDiagnostic::NO_INDEX, BoundDiagnostic::NO_INDEX, bound.segment_idx, bound.derivative_idx, 
+              bound_idx, message.str());
+        }
+      }
+
+      /*
+       * NODE INTERVALS
+       */
+      NodeIntervals intervals(constants, num_bounded_derivatives, arena);
+      for(size_t bound_idx = 0; bound_idx < bounds.node_equality_bounds.size(); ++bound_idx) {
+        const NodeEqualityBound& bound = bounds.node_equality_bounds[bound_idx];
+        if(false == intervals.Intersect(
+              bound.dimension_idx, bound.node_idx, bound.derivative_idx, bound.value, bound.value)) {
+          message << "Node equality bound " << bound_idx << EmptyIntervalReason(
+              constants, bound.dimension_idx, bound.node_idx, bound.derivative_idx, 
+              " contradicts an earlier node bound.");
+          return Conflict(
+              BoundConflict::EMPTY_NODE_INTERVAL, 
+              bound.dimension_idx, bound.node_idx, BoundDiagnostic::NO_INDEX, bound.derivative_idx, 
+              bound_idx, message.str());
+        }
+      }
+      for(size_t bound_idx = 0; bound_idx < bounds.node_inequality_bounds.size(); ++bound_idx) {
+        const NodeInequalityBound& bound = bounds.node_inequality_bounds[bound_idx];
+        if(false == intervals.Intersect(
+              bound.dimension_idx, bound.node_idx, bound.derivative_idx, bound.lower, bound.upper)) {
+          message << "Node inequality bound " << bound_idx << EmptyIntervalReason(
+              constants, bound.dimension_idx, bound.node_idx, bound.derivative_idx, 
+              " contradicts itself or an earlier node bound.");
+          return Conflict(
+              BoundConflict::EMPTY_NODE_INTERVAL, 
+              bound.dimension_idx, bound.node_idx, BoundDiagnostic::NO_INDEX, bound.derivative_idx, 
+              bound_idx, message.str());
+        }
+      }
+      for(size_t bound_idx = 0; bound_idx < bounds.node_range_bounds.size(); ++bound_idx) {
+        const NodeRangeBound& bound = bounds.node_range_bounds[bound_idx];
+        IndexRange dimensions, nodes;
+        CoveredRanges(constants, bound, dimensions, nodes);
+        for(size_t dimension_idx = dimensions.begin; dimension_idx < dimensions.end; ++dimension_idx) {
+          for(size_t node_idx = nodes.begin; node_idx < nodes.end; ++node_idx) {
+            if(false == intervals.Intersect(
+                  dimension_idx, node_idx, bound.derivative_idx, bound.lower, bound.upper)) {
+              message << "Node range bound " << bound_idx << EmptyIntervalReason(
+                  constants, dimension_idx, node_idx, bound.derivative_idx, 
+                  " contradicts itself or an earlier node bound.");
+              return Conflict(
+                  BoundConflict::EMPTY_NODE_INTERVAL, 
+                  dimension_idx, node_idx, BoundDiagnostic::NO_INDEX, bound.derivative_idx, 
+                  bound_idx, message.str());
+            }
+          }
+        }
+      }
+      for(size_t bound_idx = 0; bound_idx < bounds.node_values_bounds.size(); ++bound_idx) {
+        const NodeValuesBound& bound = bounds.node_values_bounds[bound_idx];
+        IndexRange dimensions, nodes;
+        CoveredRanges(constants, bound, dimensions, nodes);
+        for(size_t dimension_idx = dimensions.begin; dimension_idx < dimensions.end; ++dimension_idx) {
+          for(size_t node_idx = nodes.begin; node_idx < nodes.end; ++node_idx) {
+            const double value 
+              = bound.values(dimension_idx - bound.dimension_begin, node_idx - bound.node_begin);
+            if(false == intervals.Intersect(dimension_idx, node_idx, bound.derivative_idx, value, value)) {
+              message << "Node values bound " << bound_idx << EmptyIntervalReason(
+                  constants, dimension_idx, node_idx, bound.derivative_idx, 
+                  " contradicts an earlier node bound.");
+              return Conflict(
+                  BoundConflict::EMPTY_NODE_INTERVAL, 
+                  dimension_idx, node_idx, BoundDiagnostic::NO_INDEX, bound.derivative_idx, 
+                  bound_idx, message.str());
+            }
+          }
+        }
+      }
+
+      /*
+       * SEGMENT ENDPOINTS
+       */
+      // Segment bounds are enforced at both endpoints of the segment, so the
+      // node intervals there must meet them. Multi-dimensional bounds are
+      // checked against the box of the node intervals.
+      size_t endpoint_nodes[2];
+      for(size_t bound_idx = 0; bound_idx < bounds.num_segment_inequality_bounds; ++bound_idx) {
+        const SegmentBoundView& bound = bounds.segment_inequality_bounds[bound_idx];
+        const size_t num_endpoints = EndpointNodes(constants, bound.segment_idx, bound.derivative_idx, endpoint_nodes);
+        for(size_t endpoint_idx = 0; endpoint_idx < num_endpoints; ++endpoint_idx) {
+          const size_t node_idx = endpoint_nodes[endpoint_idx];
+          double minimum = 0;
+          bool bounded = true;
+          for(size_t dimension_idx = 0; dimension_idx < constants.num_dimensions && true == bounded; ++dimension_idx) {
+            bounded = AddMinimum(
+                intervals, dimension_idx, node_idx, bound.derivative_idx, bound.mapping[dimension_idx], minimum);
+          }
+          if(true == bounded && true == Exceeds(minimum, bound.value)) {
+            message << "Segment inequality bound " << bound_idx << " is violated by the node bounds of node " << node_idx << ".";
+            return Conflict(
+                BoundConflict::ENDPOINT_CONFLICT, 
+                BoundDiagnostic::NO_INDEX, node_idx, bound.segment_idx, bound.derivative_idx, 
+                bound_idx, message.str());
+          }
+        }
+      }
+      for(size_t bound_idx = 0; bound_idx < bounds.segment_box_bounds.size(); ++bound_idx) {
+        const SegmentBoxBound& bound = bounds.segment_box_bounds[bound_idx];
+        const size_t num_endpoints = EndpointNodes(constants, bound.segment_idx, bound.derivative_idx, endpoint_nodes);
+        for(size_t endpoint_idx = 0; endpoint_idx < num_endpoints; ++endpoint_idx) {
+          const size_t node_idx = endpoint_nodes[endpoint_idx];
+          if(true == Exceeds(intervals.Lower(bound.dimension_idx, node_idx, bound.derivative_idx), bound.upper)
+              || true == Exceeds(bound.lower, intervals.Upper(bound.dimension_idx, node_idx, bound.derivative_idx))) {
+            message << "Segment box bound " << bound_idx << " is violated by the node bounds of node " << node_idx << ".";
+            return Conflict(
+                BoundConflict::ENDPOINT_CONFLICT, 
+                bound.dimension_idx, node_idx, bound.segment_idx, bound.derivative_idx, 
+                bound_idx, message.str());
+          }
+        }
+      }
+      for(size_t bound_idx = 0; bound_idx < bounds.segment_polytope_bounds.size(); ++bound_idx) {
+        const SegmentPolytopeBound& bound = bounds.segment_polytope_bounds[bound_idx];
+        const size_t num_endpoints = EndpointNodes(constants, bound.segment_idx, bound.derivative_idx, endpoint_nodes);
+        for(size_t endpoint_idx = 0; endpoint_idx < num_endpoints; ++endpoint_idx) {
+          const size_t node_idx = endpoint_nodes[endpoint_idx];
+          for(Eigen::Index face_idx = 0; face_idx < bound.faces.outerSize(); ++face_idx) {
+            double minimum = 0;
+            bool bounded = true;
+            for(Eigen::SparseMatrix<double, Eigen::RowMajor>::InnerIterator entry(bound.faces, face_idx); 
+                entry && static_cast<size_t>(entry.index()) < constants.num_dimensions && true == bounded; ++entry) {
+              bounded = AddMinimum(
+                  intervals, entry.index(), node_idx, bound.derivative_idx, entry.value(), minimum);
+            }
+            if(true == bounded && true == Exceeds(minimum, bound.offsets(face_idx))) {
+              message << "Face " << face_idx << " of segment polytope bound " << bound_idx 
+                << " is violated by the node bounds of node " << node_idx << ".";
+              return Conflict(
+                  BoundConflict::ENDPOINT_CONFLICT, 
+                  BoundDiagnostic::NO_INDEX, node_idx, bound.segment_idx, bound.derivative_idx, 
+                  bound_idx, message.str());
+            }
+          }
+        }
+      }
+      for(size_t bound_idx = 0; bound_idx < bounds.segment_range_bounds.size(); ++bound_idx) {
+        const SegmentRangeBound& bound = bounds.segment_range_bounds[bound_idx];
+        IndexRange dimensions, segments;
+        CoveredRanges(constants, bound, dimensions, segments);
+        for(size_t segment_idx = segments.begin; segment_idx < segments.end; ++segment_idx) {
+          const size_t num_endpoints = EndpointNodes(constants, segment_idx, bound.derivative_idx, endpoint_nodes);
+          for(size_t endpoint_idx = 0; endpoint_idx < num_endpoints; ++endpoint_idx) {
+            const size_t node_idx = endpoint_nodes[endpoint_idx];
+            for(size_t dimension_idx = dimensions.begin; dimension_idx < dimensions.end; ++dimension_idx) {
+              if(true == Exceeds(intervals.Lower(dimension_idx, node_idx, bound.derivative_idx), bound.upper)
+                  || true == Exceeds(bound.lower, intervals.Upper(dimension_idx, node_idx, bound.derivative_idx))) {
+                message << "Segment range bound " << bound_idx << " is violated by the node bounds of node " << node_idx << ".";
+                return Conflict(
+                    BoundConflict::ENDPOINT_CONFLICT, 
+                    dimension_idx, node_idx, segment_idx, bound.derivative_idx, 
+                    bound_idx, message.str());
+              }
+            }
+          }
+        }
+      }
+
+      return BoundDiagnostic();
+    }
+
+    // Tasks per thread. More tasks than threads balances nodes with many
+    // bounds against nodes with few.
+    constexpr size_t kTasksPerThread = 4;
+
+    // Number of chunks a range of count items is split into. Without a
+    // thread pool the range is not split.
+    size_t NumChunks(
+        const size_t count,
+        const ThreadPool* thread_pool) {
+      if(0 == count) {
+        return 0;
+      }
+      if(nullptr == thread_pool) {
+        return 1;
+      }
+      return std::min(count, kTasksPerThread * thread_pool->NumThreads());
+    }
+
+    // First item of a chunk of a range of count items
+    size_t ChunkBegin(
+        const size_t count,
+        const size_t num_chunks,
+        const size_t chunk_idx) {
+      return count * chunk_idx / num_chunks;
+    }
+
+    // Runs task(task_idx) for every task_idx in [0, num_tasks), on the thread
+    // pool if one is provided.
+    template <class Task>
+    void RunTasks(
+        ThreadPool* thread_pool,
+        const size_t num_tasks,
+        const Task& task) {
+      if(nullptr == thread_pool) {
+        for(size_t task_idx = 0; task_idx < num_tasks; ++task_idx) {
+          task(task_idx);
+        }
+        return;
+      }
+      thread_pool->ParallelFor(num_tasks, task);
+    }
+
+    // Counts the number of non-zero entries in each column of the constraint
+    // matrix. Used as the first pass of the two-pass CSC assembly. Terminal
+    // entries are counted separately; see CscWriter.
+    class ColumnCounter {
+      public:
+        ColumnCounter(
+            c_int* column_counts,
+            c_int* terminal_counts)
+          : column_counts_(column_counts),
+            terminal_counts_(terminal_counts) {}
+
+        void SetBounds(
+            const size_t /*row*/, 
+            const double /*lower*/, 
+            const double /*upper*/) {}
+
+        void SetSamplePoint(
+            const size_t /*row*/, 
+            const size_t /*point_idx*/,
+            const size_t /*num_points*/) {}
+
+        void SetRowScale(
+            const size_t /*row*/, 
+            const double /*scale*/) {}
+
+        void Insert(
+            const size_t /*row*/, 
+            const size_t col, 
+            const double /*value*/) {
+          column_counts_[col]++;
+        }
+
+        void InsertTerminal(
+            const size_t /*row*/, 
+            const size_t col, 
+            const double /*value*/) {
+          terminal_counts_[col]++;
+        }
+
+      private:
+        c_int* column_counts_;
+        c_int* terminal_counts_;
+    };
+
+    // Writes the constraint matrix and bound vectors directly into
+    // pre-allocated OSQP storage. Used as the second pass of the two-pass CSC
+    // assembly. Entries are written at per-column cursors; rows must be
+    // inserted in increasing order so that the row indices within each
+    // column remain sorted.
+    //
+    // A terminal entry is a coefficient of the next segment in a continuity
+    // constraint. The terminal entries of a column all come from the
+    // continuity rows of a single node, and their rows precede every other
+    // row of the column, so they are written to the first slots of the
+    // column at their own cursors. This lets the continuity rows of a node be
+    // generated independently of the rows of the next node. In the monomial
+    // basis a column holds at most one.
+    //
+    // If row scales are requested, the entries and bounds of a row are
+    // multiplied by its scale, which must be set before anything else of the
+    // row.
+    class CscWriter {
+      public:
+        CscWriter(
+            csc* mat,
+            c_float* lower_bound_vec,
+            c_float* upper_bound_vec,
+            c_int* cursors,
+            c_int* terminal_cursors,
+            c_int* sample_points,
+            c_float* row_scales)
+          : mat_(mat),
+            lower_bound_vec_(lower_bound_vec),
+            upper_bound_vec_(upper_bound_vec),
+            cursors_(cursors),
+            terminal_cursors_(terminal_cursors),
+            sample_points_(sample_points),
+            row_scales_(row_scales) {}
+
+        void SetBounds(
+            const size_t row, 
+            const double lower, 
+            const double upper) {
+          if(nullptr != row_scales_) {
+            lower_bound_vec_[row] = ScaleBound(lower, row_scales_[row]);
+            upper_bound_vec_[row] = ScaleBound(upper, row_scales_[row]);
+            return;
+          }
+          lower_bound_vec_[row] = lower;
+          upper_bound_vec_[row] = upper;
+        }
+
+        // Records how far the point of a segment bound row is from the
+        // nearest endpoint of the segment, if requested. Endpoint rows are 0.
+        void SetSamplePoint(
+            const size_t row, 
+            const size_t point_idx,
+            const size_t num_points) {
+          if(nullptr != sample_points_) {
+            sample_points_[row] = std::min(point_idx, num_points - 1 - point_idx);
+          }
+        }
+
+        // Records the equilibration scale of a row, if requested
+        void SetRowScale(
+            const size_t row, 
+            const double scale) {
+          if(nullptr != row_scales_) {
+            row_scales_[row] = scale;
+          }
+        }
+
+        void Insert(
+            const size_t row, 
+            const size_t col, 
+            const double value) {
+          const c_int nz_idx = cursors_[col]++;
+          mat_->i[nz_idx] = row;
+          mat_->x[nz_idx] = nullptr != row_scales_ ? value * row_scales_[row] : value;
+        }
+
+        void InsertTerminal(
+            const size_t row, 
+            const size_t col, 
+            const double value) {
+          const c_int nz_idx = terminal_cursors_[col]++;
+          mat_->i[nz_idx] = row;
+          mat_->x[nz_idx] = nullptr != row_scales_ ? value * row_scales_[row] : value;
+        }
+
+      private:
+        csc* mat_;
+        c_float* lower_bound_vec_;
+        c_float* upper_bound_vec_;
+        c_int* cursors_;
+        c_int* terminal_cursors_;
+        c_int* sample_points_;
+        c_float* row_scales_;
+    };
+
+    // Writes only the bound vectors. Regenerates the bounds of an assembled
+    // problem, whose rows keep their entries. If row scales are given, the
+    // bounds of every row are multiplied by its scale.
+    class BoundWriter {
+      public:
+        BoundWriter(
+            c_float* lower_bound_vec,
+            c_float* upper_bound_vec,
+            const c_float* row_scales)
+          : lower_bound_vec_(lower_bound_vec),
+            upper_bound_vec_(upper_bound_vec),
+            row_scales_(row_scales) {}
+
+        void SetBounds(
+            const size_t row, 
+            const double lower, 
+            const double upper) {
+          const double scale = nullptr != row_scales_ ? row_scales_[row] : 1.0;
+          lower_bound_vec_[row] = ScaleBound(lower, scale);
+          upper_bound_vec_[row] = ScaleBound(upper, scale);
+        }
+
+        void SetSamplePoint(
+            const size_t /*row*/, 
+            const size_t /*point_idx*/,
+            const size_t /*num_points*/) {}
+
+        void SetRowScale(
+            const size_t /*row*/, 
+            const double /*scale*/) {}
+
+        void Insert(
+            const size_t /*row*/, 
+            const size_t /*col*/, 
+            const double /*value*/) {}
+
+        void InsertTerminal(
+            const size_t /*row*/, 
+            const size_t /*col*/, 
+            const double /*value*/) {}
+
+      private:
+        c_float* lower_bound_vec_;
+        c_float* upper_bound_vec_;
+        const c_float* row_scales_;
+    };
+
+    // Allocates an m-by-n CSC matrix with room for num_nz entries from the
+    // arena. OSQP copies its input data during setup, so the matrix only has
+    // to outlive the call to osqp_setup.
+    csc* AllocateCsc(
+        const size_t m,
+        const size_t n,
+        const size_t num_nz,
+        Arena& arena) {
+      csc* mat = arena.Allocate<csc>(1);
+      mat->m = m;
+      mat->n = n;
+      mat->nzmax = num_nz;
+      mat->nz = -1;
+      mat->p = arena.Allocate<c_int>(n + 1);
+      mat->i = arena.Allocate<c_int>(num_nz);
+      mat->x = arena.Allocate<c_float>(num_nz);
+      return mat;
+    }
+
+    // Copies the rows of a CSC matrix selected by a row map, which holds the
+    // index of every kept row in the copy and -1 for every dropped row. Rows
+    // keep their relative order, so row indices stay sorted.
+    csc* SelectRows(
+        const csc* mat,
+        const c_int* row_map,
+        const size_t num_rows,
+        Arena& arena) {
+      c_int num_nz = 0;
+      for(c_int nz_idx = 0; nz_idx < mat->p[mat->n]; ++nz_idx) {
+        if(-1 != row_map[mat->i[nz_idx]]) {
+          num_nz++;
+        }
+      }
+
+      csc* selected = AllocateCsc(num_rows, mat->n, num_nz, arena);
+      c_int selected_idx = 0;
+      for(c_int col = 0; col < mat->n; ++col) {
+        selected->p[col] = selected_idx;
+        for(c_int nz_idx = mat->p[col]; nz_idx < mat->p[col + 1]; ++nz_idx) {
+          const c_int row = row_map[mat->i[nz_idx]];
+          if(-1 != row) {
+            selected->i[selected_idx] = row;
+            selected->x[selected_idx] = mat->x[nz_idx];
+            selected_idx++;
+          }
+        }
+      }
+      selected->p[mat->n] = selected_idx;
+      return selected;
+    }
+
+    // Predicts the bytes OSQP allocates to set up and solve a problem: a copy
+    // of the problem data, the scaling and iterate vectors, and the KKT
+    // matrix with its LDL factor, twice if the solution is polished. The
+    // factor is assumed to have the fill of the KKT matrix, which holds for
+    // the banded problems of a trajectory.
+    size_t PredictOsqpMemory(
+        const OSQPData& data,
+        const OSQPSettings& settings) {
+      const size_t n = data.n;
+      const size_t m = data.m;
+      const size_t entry_size = sizeof(c_int) + sizeof(c_float);
+      const size_t num_nz = data.P->p[n] + data.A->p[n];
+
+      // Problem data, including the column pointers of P and A
+      const size_t data_bytes = num_nz * entry_size
+        + 2 * (n + 1) * sizeof(c_int)
+        + (n + 2 * m) * sizeof(c_float);
+
+      // Scaling, step-size and iterate vectors
+      const size_t vector_bytes = 14 * (n + m) * sizeof(c_float) + m * sizeof(c_int);
+
+      // KKT matrix and factor, plus the permutation and elimination tree
+      // workspace
+      const size_t kkt_bytes = 2 * (num_nz + n + m) * entry_size + 10 * (n + m) * sizeof(c_int);
+
+      return data_bytes + vector_bytes + (0 != settings.polish ? 2 : 1) * kkt_bytes;
+    }
+
+    // Writes the product of a CSC matrix and a vector
+    void Multiply(
+        const csc* mat,
+        const double* x,
+        double* product) {
+      std::fill(product, product + mat->m, 0);
+      for(c_int col = 0; col < mat->n; ++col) {
+        for(c_int nz_idx = mat->p[col]; nz_idx < mat->p[col + 1]; ++nz_idx) {
+          product[mat->i[nz_idx]] += mat->x[nz_idx] * x[col];
+        }
+      }
+    }
+
+    // Scales every row of a CSC matrix and its bounds so that its largest
+    // entry is one. Writes the scale of every row.
+    void NormalizeRows(
+        csc* mat,
+        c_float* lower_bound_vec,
+        c_float* upper_bound_vec,
+        c_float* row_scales) {
+      std::fill(row_scales, row_scales + mat->m, 0);
+      for(c_int nz_idx = 0; nz_idx < mat->p[mat->n]; ++nz_idx) {
+        row_scales[mat->i[nz_idx]] = std::max<c_float>(row_scales[mat->i[nz_idx]], std::abs(mat->x[nz_idx]));
+      }
+      for(c_int row = 0; row < mat->m; ++row) {
+        row_scales[row] = RowScale(row_scales[row]);
+        lower_bound_vec[row] = ScaleBound(lower_bound_vec[row], row_scales[row]);
+        upper_bound_vec[row] = ScaleBound(upper_bound_vec[row], row_scales[row]);
+      }
+      for(c_int nz_idx = 0; nz_idx < mat->p[mat->n]; ++nz_idx) {
+        mat->x[nz_idx] *= row_scales[mat->i[nz_idx]];
+      }
+    }
+
+    // Generates the rows of the constraint matrix and the upper and lower
+    // bound vectors. Rows and bounds are passed to a sink, allowing the same
+    // generator to both count and write entries. Zero entries are never
+    // emitted.
+    //
+    // Rows are grouped into units, one per (dimension, segment) and ordered
+    // like the blocks of the variable layout: the bounds of the node at the
+    // start of the segment followed by the continuity constraints with the
+    // next segment. The segment inequality bounds follow every unit, then the
+    // segment box bounds, then the segment polytope bounds, then the segment
+    // range bounds. The first row of
+    // every unit and bound is known up front, so the rows are split into
+    // tasks that can be generated in any order: node tasks each cover a
+    // range of units, and segment tasks each cover the segment bounds of a
+    // range of segments. Within a pass, tasks touch disjoint rows and
+    // columns.
+    class ConstraintGenerator {
+      public:
+        ConstraintGenerator(
+            const Constants& constants,
+            const PolynomialBasis& basis,
+            const std::vector<double>& times,
+            const ProblemBounds& bounds,
+            const ThreadPool* thread_pool,
+            Arena& arena)
+          : constants_(constants),
+            times_(times),
+            bounds_(bounds),
+            node_equality_index_(constants, bounds.node_equality_bounds, arena),
+            node_inequality_index_(constants, bounds.node_inequality_bounds, arena),
+            node_range_index_(constants, bounds.node_range_bounds, arena),
+            node_values_index_(constants, bounds.node_values_bounds, arena),
+            segment_inequality_index_(
+                constants, bounds.segment_inequality_bounds, bounds.num_segment_inequality_bounds, arena),
+            segment_box_index_(
+                constants, bounds.segment_box_bounds.data(), bounds.segment_box_bounds.size(), arena),
+            segment_polytope_index_(
+                constants, bounds.segment_polytope_bounds.data(), bounds.segment_polytope_bounds.size(), arena),
+            time_vectors_(constants, basis, arena),
+            num_node_chunks_(NumChunks(constants.layout.NumBlocks(), thread_pool)),
+            num_segment_chunks_(NumChunks(constants.num_segments, thread_pool)) {
+          const size_t num_units = constants.layout.NumBlocks();
+          unit_row_offsets_ = arena.Allocate<size_t>(num_units + 1);
+          unit_row_offsets_[0] = 0;
+          for(size_t unit_idx = 0; unit_idx < num_units; ++unit_idx) {
+            const size_t dimension_idx = constants.layout.BlockDimension(unit_idx);
+            const size_t segment_idx = constants.layout.BlockSegment(unit_idx);
+            size_t num_rows = this->NumNodeBounds(dimension_idx, segment_idx);
+            if(segment_idx + 1 < constants.num_segments) {
+              num_rows += constants.num_continuity_constraints;
+            } else {
+              num_rows += this->NumNodeBounds(dimension_idx, segment_idx + 1);
+            }
+            unit_row_offsets_[unit_idx + 1] = unit_row_offsets_[unit_idx] + num_rows;
+          }
+
+          // Segment bounds have a row per point, polytope bounds a row per
+          // face and point, and range bounds a row per covered (segment,
+          // dimension) pair and point. See NumBoundPoints.
+          size_t first_row = unit_row_offsets_[num_units];
+          const size_t num_inequality_bounds = bounds.num_segment_inequality_bounds;
+          inequality_row_offsets_ = arena.Allocate<size_t>(num_inequality_bounds + 1);
+          for(size_t bound_idx = 0; bound_idx < num_inequality_bounds; ++bound_idx) {
+            inequality_row_offsets_[bound_idx] = first_row;
+            first_row += NumBoundRows(constants, bounds.segment_inequality_bounds[bound_idx]);
+          }
+          inequality_row_offsets_[num_inequality_bounds] = first_row;
+
+          const size_t num_box_bounds = bounds.segment_box_bounds.size();
+          box_row_offsets_ = arena.Allocate<size_t>(num_box_bounds + 1);
+          for(size_t bound_idx = 0; bound_idx < num_box_bounds; ++bound_idx) {
+            box_row_offsets_[bound_idx] = first_row;
+            first_row += NumBoundRows(constants, bounds.segment_box_bounds[bound_idx]);
+          }
+          box_row_offsets_[num_box_bounds] = first_row;
+
+          const size_t num_polytope_bounds = bounds.segment_polytope_bounds.size();
+          polytope_row_offsets_ = arena.Allocate<size_t>(num_polytope_bounds + 1);
+          for(size_t bound_idx = 0; bound_idx < num_polytope_bounds; ++bound_idx) {
+            const SegmentPolytopeBound& bound = bounds.segment_polytope_bounds[bound_idx];
+            polytope_row_offsets_[bound_idx] = first_row;
+            first_row += NumBoundRows(constants, bound);
+          }
+          polytope_row_offsets_[num_polytope_bounds] = first_row;
+
+          const size_t num_range_bounds = bounds.segment_range_bounds.size();
+          segment_range_row_offsets_ = arena.Allocate<size_t>(num_range_bounds + 1);
+          for(size_t bound_idx = 0; bound_idx < num_range_bounds; ++bound_idx) {
+            const SegmentRangeBound& bound = bounds.segment_range_bounds[bound_idx];
+            segment_range_row_offsets_[bound_idx] = first_row;
+            first_row += NumCovered(constants, bound) * NumBoundPoints(constants, bound.derivative_idx);
+          }
+          segment_range_row_offsets_[num_range_bounds] = first_row;
+        }
+
+        size_t NumTasks() const {
+          return num_node_chunks_ + num_segment_chunks_;
+        }
+
+        // Generates the rows of a single task. Node rows are passed to the
+        // node sink and segment bound rows to the segment sink.
+        template <class Sink>
+        void SetConstraints(
+            const size_t task_idx,
+            Sink& node_sink,
+            Sink& segment_sink) const {
+          if(task_idx < num_node_chunks_) {
+            const size_t num_units = constants_.layout.NumBlocks();
+            this->SetNodeConstraints(
+                ChunkBegin(num_units, num_node_chunks_, task_idx),
+                ChunkBegin(num_units, num_node_chunks_, task_idx + 1),
+                node_sink);
+          } else {
+            const size_t chunk_idx = task_idx - num_node_chunks_;
+            this->SetSegmentConstraints(
+                ChunkBegin(constants_.num_segments, num_segment_chunks_, chunk_idx),
+                ChunkBegin(constants_.num_segments, num_segment_chunks_, chunk_idx + 1),
+                segment_sink);
+          }
+        }
+
+      private:
+        // Number of node bounds applied to a node of a dimension
+        size_t NumNodeBounds(
+            const size_t dimension_idx,
+            const size_t node_idx) const {
+          size_t num_bounds = 0;
+          for(size_t derivative_idx = 0; derivative_idx < constants_.num_params_per_segment_per_dim; ++derivative_idx) {
+            num_bounds += 
+              node_equality_index_.End(dimension_idx, node_idx, derivative_idx)
+              - node_equality_index_.Begin(dimension_idx, node_idx, derivative_idx);
+            num_bounds += 
+              node_inequality_index_.End(dimension_idx, node_idx, derivative_idx)
+              - node_inequality_index_.Begin(dimension_idx, node_idx, derivative_idx);
+            num_bounds += 
+              node_range_index_.End(dimension_idx, node_idx, derivative_idx)
+              - node_range_index_.Begin(dimension_idx, node_idx, derivative_idx);
+            num_bounds += 
+              node_values_index_.End(dimension_idx, node_idx, derivative_idx)
+              - node_values_index_.Begin(dimension_idx, node_idx, derivative_idx);
+          }
+          return num_bounds;
+        }
+
+        // Node bound and continuity constraints of units [unit_begin,
+        // unit_end). A unit holds the bounds of the node at the start of its
+        // segment followed by the continuity constraints with the next
+        // segment. The unit of the final segment holds the bounds of the
+        // final node instead.
+        template <class Sink>
+        void SetNodeConstraints(
+            const size_t unit_begin,
+            const size_t unit_end,
+            Sink& sink) const {
+          const Constants& constants = constants_;
+          const std::vector<double>& times = times_;
+          size_t constraint_idx = unit_row_offsets_[unit_begin];
+          for(size_t unit_idx = unit_begin; unit_idx < unit_end; ++unit_idx) {
+            const size_t dimension_idx = constants.layout.BlockDimension(unit_idx);
+            const size_t node_idx = constants.layout.BlockSegment(unit_idx);
+
+            this->SetNodeBounds(dimension_idx, node_idx, constraint_idx, sink);
+            if(node_idx + 1 == constants.num_segments) {
+              this->SetNodeBounds(dimension_idx, node_idx + 1, constraint_idx, sink);
+              continue;
+            }
+
+            // Continuity constraints
+            const size_t num_continuity_constraints = constants.num_continuity_constraints;
+            const double alpha_k = times[node_idx + 1] - times[node_idx];
+            const double alpha_kp1 = times[node_idx + 2] - times[node_idx + 1];
+
+            // Time vectors of a lower-order polynomial are the leading
+            // entries of the cached time vectors
+            const size_t num_current_params = constants.layout.NumCoefficients(dimension_idx, node_idx);
+            const size_t num_next_params = constants.layout.NumCoefficients(dimension_idx, node_idx + 1);
+
+            for(size_t continuity_idx = 0; continuity_idx < num_continuity_constraints; ++continuity_idx) {
+              // Constraints. Scaled by alpha. See documentation.
+              // Propagate the current node
+              const double* time_vector = time_vectors_.TerminalRow(continuity_idx);
+              const double propagation_scale = 1.0 / std::pow(alpha_k, continuity_idx);
+              const double* start_vector = time_vectors_.StartRow(continuity_idx);
+              const double next_scale = -1.0 / std::pow(alpha_kp1, continuity_idx);
+
+              // The alpha powers of the two segments set the magnitude of
+              // the row
+              sink.SetRowScale(constraint_idx, RowScale(std::max(
+                      MaxAbs(time_vector, num_current_params) * propagation_scale,
+                      MaxAbs(start_vector, num_next_params) * -next_scale)));
+
+              // Bounds
+              sink.SetBounds(constraint_idx, 0, 0);
+
+              const size_t current_segment_idx = constants.layout.Index(dimension_idx, node_idx, 0);
+              const size_t next_segment_idx = constants.layout.Index(dimension_idx, node_idx + 1, 0);
+
+              for(size_t param_idx = 0; param_idx < num_current_params; ++param_idx) {
+                if(0.0 != time_vector[param_idx]) {
+                  sink.Insert(
+                      constraint_idx, 
+                      current_segment_idx + param_idx, 
+                      time_vector[param_idx] * propagation_scale);
+                }
+              }
+
+              // Minus the next node. In the monomial basis, only the
+              // coefficient of the constrained derivative is non-zero.
+              for(size_t param_idx = 0; param_idx < num_next_params; ++param_idx) {
+                if(0.0 != start_vector[param_idx]) {
+                  sink.InsertTerminal(
+                      constraint_idx, 
+                      next_segment_idx + param_idx, 
+                      start_vector[param_idx] * next_scale);
+                }
+              }
+
+              constraint_idx++;
+            }
+          }
+        }
+
+        // Equality, inequality, range and values bounds of a single node, in
+        // that order for every derivative. A node is
+        // constrained at the start (tau = 0) of the segment that follows it,
+        // where, in the monomial basis, the constrained derivative is a single
+        // coefficient. The final
+        // node has no following segment and is constrained at the end (tau =
+        // 1) of the final segment.
+        template <class Sink>
+        void SetNodeBounds(
+            const size_t dimension_idx,
+            const size_t node_idx,
+            size_t& constraint_idx,
+            Sink& sink) const {
+          const bool is_final_node = node_idx == constants_.num_segments;
+          const size_t segment_idx = is_final_node ? node_idx - 1 : node_idx;
+          const double alpha = times_[segment_idx + 1] - times_[segment_idx];
+
+          for(size_t derivative_idx = 0; derivative_idx < constants_.num_params_per_segment_per_dim; ++derivative_idx) {
+            // Bounds are scaled by alpha. See documentation.
+            const double scale = std::pow(alpha, derivative_idx);
+            const double row_scale 
+              = this->NodeRowScale(dimension_idx, segment_idx, derivative_idx, is_final_node);
+
+            // Equality Constraints
+            for(const size_t* it = node_equality_index_.Begin(dimension_idx, node_idx, derivative_idx);
+                it != node_equality_index_.End(dimension_idx, node_idx, derivative_idx); ++it) {
+              const NodeEqualityBound& bound = bounds_.node_equality_bounds[*it];
+              sink.SetRowScale(constraint_idx, row_scale);
+              sink.SetBounds(constraint_idx, bound.value * scale, bound.value * scale);
+              this->InsertNodeRow(constraint_idx, dimension_idx, segment_idx, derivative_idx, is_final_node, sink);
+              constraint_idx++;
+            }
+
+            // Node inequality bound constraints
+            for(const size_t* it = node_inequality_index_.Begin(dimension_idx, node_idx, derivative_idx);
+                it != node_inequality_index_.End(dimension_idx, node_idx, derivative_idx); ++it) {
+              const NodeInequalityBound& bound = bounds_.node_inequality_bounds[*it];
+              sink.SetRowScale(constraint_idx, row_scale);
+              sink.SetBounds(constraint_idx, bound.lower * scale, bound.upper * scale);
+              this->InsertNodeRow(constraint_idx, dimension_idx, segment_idx, derivative_idx, is_final_node, sink);
+              constraint_idx++;
+            }
+
+            // Node range bound constraints
+            for(const size_t* it = node_range_index_.Begin(dimension_idx, node_idx, derivative_idx);
+                it != node_range_index_.End(dimension_idx, node_idx, derivative_idx); ++it) {
+              const NodeRangeBound& bound = bounds_.node_range_bounds[*it];
+              sink.SetRowScale(constraint_idx, row_scale);
+              sink.SetBounds(constraint_idx, ScaleBound(bound.lower, scale), ScaleBound(bound.upper, scale));
+              this->InsertNodeRow(constraint_idx, dimension_idx, segment_idx, derivative_idx, is_final_node, sink);
+              constraint_idx++;
+            }
+
+            // Node values bound constraints
+            for(const size_t* it = node_values_index_.Begin(dimension_idx, node_idx, derivative_idx);
+                it != node_values_index_.End(dimension_idx, node_idx, derivative_idx); ++it) {
+              const NodeValuesBound& bound = bounds_.node_values_bounds[*it];
+              const double value 
+                = bound.values(dimension_idx - bound.dimension_begin, node_idx - bound.node_begin) * scale;
+              sink.SetRowScale(constraint_idx, row_scale);
+              sink.SetBounds(constraint_idx, value, value);
+              this->InsertNodeRow(constraint_idx, dimension_idx, segment_idx, derivative_idx, is_final_node, sink);
+              constraint_idx++;
+            }
+          }
+        }
+
+        // Equilibration scale of the row of a node bound. The row is a time
+        // vector, so its magnitude does not depend on alpha.
+        double NodeRowScale(
+            const size_t dimension_idx,
+            const size_t segment_idx,
+            const size_t derivative_idx,
+            const bool at_end) const {
+          const double* time_vector = true == at_end
+            ? time_vectors_.TerminalRow(derivative_idx)
+            : time_vectors_.StartRow(derivative_idx);
+          return RowScale(MaxAbs(time_vector, constants_.layout.NumCoefficients(dimension_idx, segment_idx)));
+        }
+
+        // Row of a node bound on a derivative of a segment, evaluated at the
+        // start or the end of the segment
+        template <class Sink>
+        void InsertNodeRow(
+            const size_t constraint_idx,
+            const size_t dimension_idx,
+            const size_t segment_idx,
+            const size_t derivative_idx,
+            const bool at_end,
+            Sink& sink) const {
+          const double* time_vector = true == at_end
+            ? time_vectors_.TerminalRow(derivative_idx)
+            : time_vectors_.StartRow(derivative_idx);
+          const size_t segment_param_idx = constants_.layout.Index(dimension_idx, segment_idx, 0);
+          const size_t num_params = constants_.layout.NumCoefficients(dimension_idx, segment_idx);
+          for(size_t param_idx = 0; param_idx < num_params; ++param_idx) {
+            if(0.0 != time_vector[param_idx]) {
+              sink.Insert(constraint_idx, segment_param_idx + param_idx, time_vector[param_idx]);
+            }
+          }
+        }
+
+        // Segment inequality, box, polytope and range bound constraints of
+        // segments [segment_begin, segment_end). Box bound rows follow every
+        // segment inequality bound row, polytope bound rows follow every box
+        // bound row and range bound rows follow every polytope bound row.
+        template <class Sink>
+        void SetSegmentConstraints(
+            const size_t segment_begin,
+            const size_t segment_end,
+            Sink& sink) const {
+          const Constants& constants = constants_;
+          const std::vector<double>& times = times_;
+
+          for(size_t segment_idx = segment_begin; segment_idx < segment_end; ++segment_idx) {
+            for(const size_t* it = segment_inequality_index_.Begin(segment_idx);
+                it != segment_inequality_index_.End(segment_idx); ++it) {
+              const SegmentBoundView& bound = bounds_.segment_inequality_bounds[*it];
+              const double alpha = times[bound.segment_idx+1] - times[bound.segment_idx];
+
+              // Bounds keep their input order in the constraint matrix
+              size_t constraint_idx = inequality_row_offsets_[*it];
+              const size_t num_points = NumBoundPoints(constants, bound.derivative_idx);
+
+              for(size_t point_idx = 0; point_idx < num_points; ++point_idx)  {
+                // Time vector at a specific point
+                const double* time_vector = time_vectors_.BoundRow(bound.derivative_idx, point_idx);
+
+                double max_abs = 0;
+                for(size_t dimension_idx = 0; dimension_idx < constants.num_dimensions; ++dimension_idx) {
+                  max_abs = std::max(max_abs, std::abs(bound.mapping[dimension_idx]) 
+                      * MaxAbs(time_vector, constants.layout.NumCoefficients(dimension_idx, bound.segment_idx)));
+                }
+                sink.SetRowScale(constraint_idx, RowScale(max_abs));
+
+                // Bounds
+                sink.SetBounds(
+                    constraint_idx,
+                    -SegmentInequalityBound::INFTY,
+                    bound.value * std::pow(alpha, bound.derivative_idx));
+                sink.SetSamplePoint(constraint_idx, point_idx, num_points);
+
+                for(size_t dimension_idx = 0; dimension_idx < constants.num_dimensions; ++dimension_idx) {
+                  if(0.0 == bound.mapping[dimension_idx]) {
+                    continue;
+                  }
+
+                  const size_t current_segment_idx = constants.layout.Index(dimension_idx, bound.segment_idx, 0);
+                  const size_t num_params = constants.layout.NumCoefficients(dimension_idx, bound.segment_idx);
+
+                  for(size_t param_idx = 0; param_idx < num_params; ++param_idx) {
+                    if(0.0 != time_vector[param_idx]) {
+                      sink.Insert(
+                          constraint_idx, 
+                          current_segment_idx + param_idx, 
+                          bound.mapping[dimension_idx] * time_vector[param_idx]);
+                    }
+                  }
+                }
+
+                constraint_idx++;
+              }
+            }
+
+            this->SetSegmentBoxConstraints(segment_idx, sink);
+            this->SetSegmentPolytopeConstraints(segment_idx, sink);
+            this->SetSegmentRangeConstraints(segment_idx, sink);
+          }
+        }
+
+        // Box bound constraints of a single segment. Every row only touches
+        // the coefficients of the bounded dimension.
+        template <class Sink>
+        void SetSegmentBoxConstraints(
+            const size_t segment_idx,
+            Sink& sink) const {
+          const Constants& constants = constants_;
+          const double alpha = times_[segment_idx + 1] - times_[segment_idx];
+
+          for(const size_t* it = segment_box_index_.Begin(segment_idx);
+              it != segment_box_index_.End(segment_idx); ++it) {
+            const SegmentBoxBound& bound = bounds_.segment_box_bounds[*it];
+            const double scale = std::pow(alpha, bound.derivative_idx);
+            const size_t segment_param_idx = constants.layout.Index(bound.dimension_idx, segment_idx, 0);
+            const size_t num_params = constants.layout.NumCoefficients(bound.dimension_idx, segment_idx);
+
+            // Bounds keep their input order in the constraint matrix
+            size_t constraint_idx = box_row_offsets_[*it];
+            const size_t num_points = NumBoundPoints(constants, bound.derivative_idx);
+            for(size_t point_idx = 0; point_idx < num_points; ++point_idx) {
+              const double* time_vector = time_vectors_.BoundRow(bound.derivative_idx, point_idx);
+              sink.SetRowScale(constraint_idx, RowScale(MaxAbs(time_vector, num_params)));
+              sink.SetBounds(
+                  constraint_idx, 
+                  ScaleBound(bound.lower, scale), 
+                  ScaleBound(bound.upper, scale));
+              sink.SetSamplePoint(constraint_idx, point_idx, num_points);
+
+              for(size_t param_idx = 0; param_idx < num_params; ++param_idx) {
+                if(0.0 != time_vector[param_idx]) {
+                  sink.Insert(constraint_idx, segment_param_idx + param_idx, time_vector[param_idx]);
+                }
+              }
+
+              constraint_idx++;
+            }
+          }
+        }
+
+        // Polytope bound constraints of a single segment. The rows of a
+        // sample point are consecutive, one per face, so that the time vector
+        // of a sample point is read once for every face and rows are visited
+        // in increasing order. A face only touches the dimensions it has
+        // entries for.
+        template <class Sink>
+        void SetSegmentPolytopeConstraints(
+            const size_t segment_idx,
+            Sink& sink) const {
+          const Constants& constants = constants_;
+          const double alpha = times_[segment_idx + 1] - times_[segment_idx];
+
+          for(const size_t* it = segment_polytope_index_.Begin(segment_idx);
+              it != segment_polytope_index_.End(segment_idx); ++it) {
+            const SegmentPolytopeBound& bound = bounds_.segment_polytope_bounds[*it];
+            const double scale = std::pow(alpha, bound.derivative_idx);
+            const Eigen::SparseMatrix<double, Eigen::RowMajor>& faces = bound.faces;
+            const size_t first_row = polytope_row_offsets_[*it];
+            const size_t num_points = NumBoundPoints(constants, bound.derivative_idx);
+
+            for(size_t point_idx = 0; point_idx < num_points; ++point_idx) {
+              const double* time_vector = time_vectors_.BoundRow(bound.derivative_idx, point_idx);
+
+              for(Eigen::Index face_idx = 0; face_idx < faces.rows(); ++face_idx) {
+                const size_t constraint_idx = first_row + point_idx * faces.rows() + face_idx;
+                double max_abs = 0;
+                for(Eigen::SparseMatrix<double, Eigen::RowMajor>::InnerIterator entry(faces, face_idx); entry; ++entry) {
+                  max_abs = std::max(max_abs, std::abs(entry.value()) 
+                      * MaxAbs(time_vector, constants.layout.NumCoefficients(entry.col(), segment_idx)));
+                }
+                sink.SetRowScale(constraint_idx, RowScale(max_abs));
+                sink.SetBounds(
+                    constraint_idx,
+                    -SegmentPolytopeBound::INFTY,
+                    ScaleBound(bound.offsets(face_idx), scale));
+                sink.SetSamplePoint(constraint_idx, point_idx, num_points);
+
+                for(Eigen::SparseMatrix<double, Eigen::RowMajor>::InnerIterator entry(faces, face_idx); entry; ++entry) {
+                  const size_t dimension_idx = entry.col();
+                  if(0.0 == entry.value()) {
+                    continue;
+                  }
+
+                  const size_t segment_param_idx = constants.layout.Index(dimension_idx, segment_idx, 0);
+                  const size_t num_params = constants.layout.NumCoefficients(dimension_idx, segment_idx);
+                  for(size_t param_idx = 0; param_idx < num_params; ++param_idx) {
+                    if(0.0 != time_vector[param_idx]) {
+                      sink.Insert(
+                          constraint_idx, 
+                          segment_param_idx + param_idx, 
+                          entry.value() * time_vector[param_idx]);
+                    }
+                  }
+                }
+              }
+            }
+          }
+        }
+
+        // Range bound constraints of a single segment. The rows of a bound are
+        // ordered by segment, then dimension, then sample point, so every
+        // (segment, dimension) pair covered by the bound has a fixed block of
+        // rows. Like box bounds, every row only touches the coefficients of
+        // a single dimension.
+        template <class Sink>
+        void SetSegmentRangeConstraints(
+            const size_t segment_idx,
+            Sink& sink) const {
+          const Constants& constants = constants_;
+          const double alpha = times_[segment_idx + 1] - times_[segment_idx];
+
+          for(size_t bound_idx = 0; bound_idx < bounds_.segment_range_bounds.size(); ++bound_idx) {
+            const SegmentRangeBound& bound = bounds_.segment_range_bounds[bound_idx];
+            IndexRange dimensions, segments;
+            CoveredRanges(constants, bound, dimensions, segments);
+            if(false == segments.Contains(segment_idx)) {
+              continue;
+            }
+
+            const double scale = std::pow(alpha, bound.derivative_idx);
+            const double lower = ScaleBound(bound.lower, scale);
+            const double upper = ScaleBound(bound.upper, scale);
+            const size_t num_points = NumBoundPoints(constants, bound.derivative_idx);
+            size_t constraint_idx = segment_range_row_offsets_[bound_idx]
+              + (segment_idx - segments.begin) * dimensions.Size() * num_points;
+
+            for(size_t dimension_idx = dimensions.begin; dimension_idx < dimensions.end; ++dimension_idx) {
+              const size_t segment_param_idx = constants.layout.Index(dimension_idx, segment_idx, 0);
+              const size_t num_params = constants.layout.NumCoefficients(dimension_idx, segment_idx);
+              for(size_t point_idx = 0; point_idx < num_points; ++point_idx) {
+                const double* time_vector = time_vectors_.BoundRow(bound.derivative_idx, point_idx);
+                sink.SetRowScale(constraint_idx, RowScale(MaxAbs(time_vector, num_params)));
+                sink.SetBounds(constraint_idx, lower, upper);
+                sink.SetSamplePoint(constraint_idx, point_idx, num_points);
+
+                for(size_t param_idx = 0; param_idx < num_params; ++param_idx) {
+                  if(0.0 != time_vector[param_idx]) {
+                    sink.Insert(constraint_idx, segment_param_idx + param_idx, time_vector[param_idx]);
+                  }
+                }
+
+                constraint_idx++;
+              }
+            }
+          }
+        }
+
+        const Constants& constants_;
+        const std::vector<double>& times_;
+        const ProblemBounds& bounds_;
+        const NodeBoundIndex<NodeEqualityBound> node_equality_index_;
+        const NodeBoundIndex<NodeInequalityBound> node_inequality_index_;
+        const NodeRangeIndex<NodeRangeBound> node_range_index_;
+        const NodeRangeIndex<NodeValuesBound> node_values_index_;
+        const SegmentBoundIndex<SegmentBoundView> segment_inequality_index_;
+        const SegmentBoundIndex<SegmentBoxBound> segment_box_index_;
+        const SegmentBoundIndex<SegmentPolytopeBound> segment_polytope_index_;
+        const TimeVectorCache time_vectors_;
+        const size_t num_node_chunks_;
+        const size_t num_segment_chunks_;
+
+        // First row of every (dimension, segment) unit, followed by the first
+        // row of the segment bounds
+        size_t* unit_row_offsets_;
+
+        // First row of every segment inequality, box, polytope and range
+        // bound, each followed by the first row after the bounds of its kind
+        size_t* inequality_row_offsets_;
+        size_t* box_row_offsets_;
+        size_t* polytope_row_offsets_;
+        size_t* segment_range_row_offsets_;
+    };
+
+    // Assembles the constraint matrix directly into an OSQP CSC matrix. The
+    // constraints are generated twice: the first pass counts the non-zero
+    // entries in each column and the second pass writes them into the
+    // pre-allocated column storage. Each pass runs its tasks on the thread
+    // pool if one is provided.
+    //
+    // Each column is laid out as its terminal entries, then the entries from
+    // node tasks, then the entries from segment tasks. Entry positions depend
+    // only on the counts, so the output does not depend on the number of
+    // threads or the order in which tasks run.
+    //
+    // If row_sample_points is not null, the distance of the point of every
+    // segment bound row from the nearest endpoint of its segment is written
+    // to it, and -1 for every other row.
+    //
+    // If row_scales is not null, every row is equilibrated: its entries and
+    // bounds are multiplied by a scale that brings its largest entry to one,
+    // and the scale is written to row_scales. Scales follow from the time
+    // vectors, the alpha powers of continuity rows and the bound mappings,
+    // so the matrix is never scanned for them.
     //
-    // See the theory documentation for further details.
-    Eigen::MatrixXd QuadraticMatrix(
-        const size_t polynomial_order,
-        const size_t derivative_order,
-        const double dt) {
-      Eigen::MatrixXd base_integrated_quadratic_matrix;
-      base_integrated_quadratic_matrix.resize(polynomial_order + 1, polynomial_order + 1);
-      base_integrated_quadratic_matrix.fill(0);
-      for(size_t row = 0; row < polynomial_order + 1; ++row) {
-        for(size_t col = 0; col < polynomial_order + 1; ++col) {
-          base_integrated_quadratic_matrix(row, col) = 
-            std::pow(dt, row + col + 1) 
-            / Factorial(row) 
-            / Factorial(col) 
-            / (row + col + 1);
-        }
-      }
-    
-      // Vector of ones
-      Eigen::MatrixXd ones_vec;
-      ones_vec.resize(polynomial_order + 1 - derivative_order, 1);
-      ones_vec.fill(1);
-    
-      // Shift the matrix down rows
-      Eigen::MatrixXd row_shift_mat;
-      row_shift_mat.resize(polynomial_order + 1, polynomial_order + 1);
-      row_shift_mat.fill(0);
-      row_shift_mat.diagonal(-1*derivative_order) = ones_vec;
-    
-      // Shift the matrix right cols
-      Eigen::MatrixXd col_shift_mat;
-      col_shift_mat.resize(polynomial_order + 1, polynomial_order + 1);
-      col_shift_mat.fill(0);
-      col_shift_mat.diagonal(+1*derivative_order) = ones_vec;
-    
-      Eigen::MatrixXd integrated_quadratic_matrix;
-      integrated_quadratic_matrix.resize(polynomial_order + 1, polynomial_order + 1);
-      integrated_quadratic_matrix = row_shift_mat * base_integrated_quadratic_matrix * col_shift_mat;
-    
-      return integrated_quadratic_matrix;
-    }
-
-    // Sets the upper and lower bound vectors for the equality and continuity
-    // constraints.
-    void SetConstraints(
+    // The matrix is allocated in the arena. The generator and the counting
+    // buffers are only needed during assembly and are allocated in the
+    // scratch arena. If column_cursors is not null, the cursors at which the
+    // terminal, node and segment entries of every column start are written
+    // to it, so that the values can be rewritten in place. See
+    // RewriteConstraints.
+    csc* AssembleConstraints(
+        const Constants& constants,
+        const PolynomialBasis& basis,
+        const std::vector<double>& times,
+        const ProblemBounds& bounds,
+        c_float* lower_bound_vec, 
+        c_float* upper_bound_vec,
+        c_int* row_sample_points,
+        c_float* row_scales,
+        c_int* column_cursors,
+        ThreadPool* thread_pool,
+        Arena& arena,
+        Arena& scratch_arena) {
+      const ConstraintGenerator generator(
+          constants, 
+          basis,
+          times,
+          bounds,
+          thread_pool,
+          scratch_arena);
+
+      const size_t num_cols = constants.total_num_params;
+      c_int* terminal_counts = scratch_arena.Allocate<c_int>(num_cols);
+      c_int* node_counts = scratch_arena.Allocate<c_int>(num_cols);
+      c_int* segment_counts = scratch_arena.Allocate<c_int>(num_cols);
+      std::fill(terminal_counts, terminal_counts + num_cols, 0);
+      std::fill(node_counts, node_counts + num_cols, 0);
+      std::fill(segment_counts, segment_counts + num_cols, 0);
+
+      RunTasks(thread_pool, generator.NumTasks(), [&](const size_t task_idx) {
+          ColumnCounter node_counter(node_counts, terminal_counts);
+          ColumnCounter segment_counter(segment_counts, terminal_counts);
+          generator.SetConstraints(task_idx, node_counter, segment_counter);
+      });
+
+      // Column pointers. The counts are converted in place into the cursors
+      // at which terminal entries, node tasks and segment tasks start
+      // writing each column.
+      c_int* column_ptrs = scratch_arena.Allocate<c_int>(num_cols + 1);
+      column_ptrs[0] = 0;
+      for(size_t col = 0; col < num_cols; ++col) {
+        const c_int node_begin = column_ptrs[col] + terminal_counts[col];
+        const c_int segment_begin = node_begin + node_counts[col];
+        column_ptrs[col + 1] = segment_begin + segment_counts[col];
+        terminal_counts[col] = column_ptrs[col];
+        node_counts[col] = node_begin;
+        segment_counts[col] = segment_begin;
+      }
+
+      csc* constraint_mat = AllocateCsc(
+          constants.num_constraints, 
+          num_cols, 
+          column_ptrs[num_cols],
+          arena);
+      std::copy(column_ptrs, column_ptrs + num_cols + 1, constraint_mat->p);
+
+      if(nullptr != column_cursors) {
+        std::copy(terminal_counts, terminal_counts + num_cols, column_cursors);
+        std::copy(node_counts, node_counts + num_cols, column_cursors + num_cols);
+        std::copy(segment_counts, segment_counts + num_cols, column_cursors + 2 * num_cols);
+      }
+
+      if(nullptr != row_sample_points) {
+        std::fill(row_sample_points, row_sample_points + constants.num_constraints, -1);
+      }
+
+      RunTasks(thread_pool, generator.NumTasks(), [&](const size_t task_idx) {
+          CscWriter node_writer(
+              constraint_mat, lower_bound_vec, upper_bound_vec, node_counts, terminal_counts, 
+              row_sample_points, row_scales);
+          CscWriter segment_writer(
+              constraint_mat, lower_bound_vec, upper_bound_vec, segment_counts, terminal_counts, 
+              row_sample_points, row_scales);
+          generator.SetConstraints(task_idx, node_writer, segment_writer);
+      });
+
+      return constraint_mat;
+    }
+
+    // Rewrites the bound vectors of a problem assembled by
+    // AssembleConstraints with the same structure. If row_scales is not
+    // null, it holds the scale of every row. The generator is allocated in
+    // the scratch arena.
+    void AssembleBounds(
+        const Constants& constants,
+        const PolynomialBasis& basis,
+        const std::vector<double>& times,
+        const ProblemBounds& bounds,
+        c_float* lower_bound_vec, 
+        c_float* upper_bound_vec,
+        const c_float* row_scales,
+        ThreadPool* thread_pool,
+        Arena& scratch_arena) {
+      const ConstraintGenerator generator(
+          constants, 
+          basis,
+          times,
+          bounds,
+          thread_pool,
+          scratch_arena);
+
+      RunTasks(thread_pool, generator.NumTasks(), [&](const size_t task_idx) {
+          BoundWriter writer(lower_bound_vec, upper_bound_vec, row_scales);
+          generator.SetConstraints(task_idx, writer, writer);
+      });
+    }
+
+    // Rewrites the entries and bound vectors of a matrix assembled by
+    // AssembleConstraints for new times, in place. Only the writing pass
+    // runs, from the column cursors kept by AssembleConstraints. Returns
+    // false if an entry vanished or appeared, i.e. the sparsity pattern
+    // changed; the matrix must then be assembled again. The generator is
+    // allocated in the scratch arena.
+    bool RewriteConstraints(
+        const Constants& constants,
+        const PolynomialBasis& basis,
+        const std::vector<double>& times,
+        const ProblemBounds& bounds,
+        const c_int* column_cursors,
+        csc* constraint_mat,
+        c_float* lower_bound_vec, 
+        c_float* upper_bound_vec,
+        c_float* row_scales,
+        ThreadPool* thread_pool,
+        Arena& scratch_arena) {
+      const ConstraintGenerator generator(
+          constants, 
+          basis,
+          times,
+          bounds,
+          thread_pool,
+          scratch_arena);
+
+      const size_t num_cols = constants.total_num_params;
+      const c_int num_nz = constraint_mat->p[num_cols];
+      c_int* cursors = scratch_arena.Allocate<c_int>(3 * num_cols);
+      std::copy(column_cursors, column_cursors + 3 * num_cols, cursors);
+      c_int* terminal_cursors = cursors;
+      c_int* node_cursors = cursors + num_cols;
+      c_int* segment_cursors = cursors + 2 * num_cols;
+      c_int* row_indices = scratch_arena.Allocate<c_int>(num_nz);
+      std::copy(constraint_mat->i, constraint_mat->i + num_nz, row_indices);
+
+      RunTasks(thread_pool, generator.NumTasks(), [&](const size_t task_idx) {
+          CscWriter node_writer(
+              constraint_mat, lower_bound_vec, upper_bound_vec, node_cursors, terminal_cursors, 
+              nullptr, row_scales);
+          CscWriter segment_writer(
+              constraint_mat, lower_bound_vec, upper_bound_vec, segment_cursors, terminal_cursors, 
+              nullptr, row_scales);
+          generator.SetConstraints(task_idx, node_writer, segment_writer);
+      });
+
+      // Every section of every column must have been filled exactly, with
+      // the rows it held before
+      for(size_t col = 0; col < num_cols; ++col) {
+        if(terminal_cursors[col] != column_cursors[num_cols + col]
+            || node_cursors[col] != column_cursors[2 * num_cols + col]
+            || segment_cursors[col] != constraint_mat->p[col + 1]) {
+          return false;
+        }
+      }
+      return std::equal(row_indices, row_indices + num_nz, constraint_mat->i);
+    }
+
+    // Assembles the upper triangle of the block-diagonal quadratic cost matrix
+    // directly into an OSQP CSC matrix. The block of a polynomial is the
+    // leading submatrix of the block of the highest-order polynomial. Zero
+    // entries are not stored. The entries of every block are counted up
+    // front, so blocks are written independently, on the thread pool if one
+    // is provided. Buffers only needed during assembly are allocated in the
+    // scratch arena.
+    csc* SetQuadraticCost(
+        const Constants& constants,
+        const PolynomialBasis& basis,
+        ThreadPool* thread_pool,
+        Arena& arena,
+        Arena& scratch_arena) {
+      const size_t num_params = constants.num_params_per_segment_per_dim;
+      double* quadratic_matrix = scratch_arena.Allocate<double>(num_params * num_params);
+      basis.QuadraticMatrix(constants.derivative_order, quadratic_matrix);
+
+      // Non-zero entries of the leading block of every size
+      size_t num_nz_per_size[kMaxPolynomialOrder + 2];
+      num_nz_per_size[0] = 0;
+      for(size_t col = 0; col < num_params; ++col) {
+        num_nz_per_size[col + 1] = num_nz_per_size[col];
+        for(size_t row = 0; row <= col; ++row) { 
+          if(0.0 != quadratic_matrix[col * num_params + row]) {
+            num_nz_per_size[col + 1]++;
+          }
+        }
+      }
+
+      const size_t num_blocks = constants.layout.NumBlocks();
+      c_int* block_nz_offsets = scratch_arena.Allocate<c_int>(num_blocks + 1);
+      block_nz_offsets[0] = 0;
+      for(size_t block_idx = 0; block_idx < num_blocks; ++block_idx) {
+        block_nz_offsets[block_idx + 1] 
+          = block_nz_offsets[block_idx] + num_nz_per_size[constants.layout.BlockSize(block_idx)];
+      }
+
+      const size_t num_nz = block_nz_offsets[num_blocks];
+      csc* quadratic_mat = AllocateCsc(
+          constants.total_num_params, 
+          constants.total_num_params, 
+          num_nz,
+          arena);
+
+      const size_t num_block_chunks = NumChunks(num_blocks, thread_pool);
+      RunTasks(thread_pool, num_block_chunks, [&](const size_t task_idx) {
+          const size_t block_begin = ChunkBegin(num_blocks, num_block_chunks, task_idx);
+          const size_t block_end = ChunkBegin(num_blocks, num_block_chunks, task_idx + 1);
+
+          for(size_t block_idx = block_begin; block_idx < block_end; ++block_idx) {
+            const size_t parameter_idx = constants.layout.BlockOffset(block_idx);
+            const size_t block_size = constants.layout.BlockSize(block_idx);
+            c_int nz_idx = block_nz_offsets[block_idx];
+
+            // Columns are written in increasing order
+            for(size_t col = 0; col < block_size; ++col) { 
+              quadratic_mat->p[parameter_idx + col] = nz_idx;
+              for(size_t row = 0; row <= col; ++row) {
+                if(0.0 != quadratic_matrix[col * num_params + row]) {
+                  quadratic_mat->i[nz_idx] = row + parameter_idx;
+                  quadratic_mat->x[nz_idx] = quadratic_matrix[col * num_params + row];
+                  nz_idx++;
+                }
+              }
+            }
+          }
+      });
+      quadratic_mat->p[constants.total_num_params] = num_nz;
+
+      return quadratic_mat;
+    }
+
+    // Validates the bounds of a problem against the options and derives its
+    // constants
+    Constants MakeConstants(
+        const PolynomialSolver::Options& options,
+        const std::vector<double>& times,
+        const ProblemBounds& bounds) {
+      for(const SegmentPolytopeBound& bound: bounds.segment_polytope_bounds) {
+        if(static_cast<size_t>(bound.faces.cols()) < options.num_dimensions) {
+          std::cerr << "PolynomialSolver::Run -- Segment polytope bound faces must have an entry for every dimension." << std::endl;
+          std::exit(EXIT_FAILURE);
+        }
+        if(bound.faces.rows() != bound.offsets.size()) {
+          std::cerr << "PolynomialSolver::Run -- Segment polytope bound must have an offset for every face." << std::endl;
+          std::exit(EXIT_FAILURE);
+        }
+      }
+
+      if(times.size() < 2) {
+        std::cerr << "PolynomialSolver::Run -- Time vector must have a size greater than one." << std::endl;
+        std::exit(EXIT_FAILURE);
+      }
+
+      Constants constants;
+      constants.num_dimensions = options.num_dimensions;
+      constants.polynomial_order = options.polynomial_order;
+      constants.derivative_order = options.derivative_order;
+      constants.continuity_order = options.continuity_order;
+      constants.num_intermediate_points = options.num_intermediate_points;
+      constants.segment_bound_points = options.segment_bound_points;
+      // Node derivatives are shared by neighbouring segments, so continuity
+      // holds by construction
+      constants.num_continuity_constraints 
+        = Formulation::NODE_DERIVATIVES == options.formulation ? 0 : constants.continuity_order + 1;
+      constants.num_nodes = times.size();
+      constants.num_segments = constants.num_nodes - 1;
+      constants.num_params_per_segment_per_dim = constants.polynomial_order + 1;
+      if(true == options.segment_polynomial_orders.empty() 
+          && true == options.dimension_polynomial_orders.empty()) {
+        constants.layout = VariableLayout(
+            options.variable_ordering,
+            constants.num_dimensions,
+            constants.num_segments,
+            constants.num_params_per_segment_per_dim);
+      } else {
+        if(false == options.segment_polynomial_orders.empty()
+            && options.segment_polynomial_orders.size() != constants.num_segments) {
+          std::cerr << "PolynomialSolver::Run -- Segment polynomial orders must have an entry for every segment." << std::endl;
+          std::exit(EXIT_FAILURE);
+        }
+
+        // The order of a polynomial is the lowest of its segment order and
+        // its dimension order
+        std::vector<size_t> num_coefficients(constants.num_dimensions * constants.num_segments);
+        for(size_t dimension_idx = 0; dimension_idx < constants.num_dimensions; ++dimension_idx) {
+          for(size_t segment_idx = 0; segment_idx < constants.num_segments; ++segment_idx) {
+            size_t polynomial_order = constants.polynomial_order;
+            if(false == options.segment_polynomial_orders.empty()) {
+              polynomial_order = std::min(polynomial_order, options.segment_polynomial_orders[segment_idx]);
+            }
+            if(false == options.dimension_polynomial_orders.empty()) {
+              polynomial_order = std::min(polynomial_order, options.dimension_polynomial_orders[dimension_idx]);
+            }
+            num_coefficients[dimension_idx * constants.num_segments + segment_idx] = polynomial_order + 1;
+          }
+        }
+        constants.layout = VariableLayout(
+            options.variable_ordering,
+            constants.num_dimensions,
+            constants.num_segments,
+            num_coefficients);
+      }
+      constants.total_num_params = constants.layout.Size();
+
+      // Range bounds have a row per covered node or segment and dimension
+      size_t num_covered_nodes = 0;
+      for(const NodeRangeBound& bound: bounds.node_range_bounds) {
+        num_covered_nodes += NumCovered(constants, bound);
+      }
+      for(const NodeValuesBound& bound: bounds.node_values_bounds) {
+        num_covered_nodes += NumCovered(constants, bound);
+      }
+
+      // Segment bounds have a row per point. See NumBoundPoints.
+      size_t num_segment_bound_rows = 0;
+      for(size_t bound_idx = 0; bound_idx < bounds.num_segment_inequality_bounds; ++bound_idx) {
+        num_segment_bound_rows += NumBoundRows(constants, bounds.segment_inequality_bounds[bound_idx]);
+      }
+      for(const SegmentBoxBound& bound: bounds.segment_box_bounds) {
+        num_segment_bound_rows += NumBoundRows(constants, bound);
+      }
+      for(const SegmentPolytopeBound& bound: bounds.segment_polytope_bounds) {
+        num_segment_bound_rows += NumBoundRows(constants, bound);
+      }
+      for(const SegmentRangeBound& bound: bounds.segment_range_bounds) {
+        num_segment_bound_rows += NumCovered(constants, bound) * NumBoundPoints(constants, bound.derivative_idx);
+      }
+
+      // Explicit constraints are provided
+      const size_t num_explicit_constraints = 0
+        + bounds.node_equality_bounds.size() 
+        + bounds.node_inequality_bounds.size() 
+        + num_covered_nodes
+        + num_segment_bound_rows;
+
+      // Implicit constraints are continuity constraints
+      const size_t num_implicit_constraints = (constants.num_segments-1)*constants.num_continuity_constraints*constants.num_dimensions;
+
+      constants.num_constraints = num_explicit_constraints + num_implicit_constraints;
+
+      return constants;
+    }
+
+    // Points the views of segment inequality bounds at the bounds
+    void ViewSegmentBounds(
+        const PolynomialSolver::Options& options,
+        const std::vector<SegmentInequalityBound>& bounds,
+        SegmentBoundView* views) {
+      for(size_t bound_idx = 0; bound_idx < bounds.size(); ++bound_idx) {
+        const SegmentInequalityBound& bound = bounds[bound_idx];
+        if(static_cast<size_t>(bound.mapping.size()) < options.num_dimensions) {
+          std::cerr << "PolynomialSolver::Run -- Segment inequality bound mapping must have an entry for every dimension." << std::endl;
+          std::exit(EXIT_FAILURE);
+        }
+        views[bound_idx].segment_idx = bound.segment_idx;
+        views[bound_idx].derivative_idx = bound.derivative_idx;
+        views[bound_idx].mapping = bound.mapping.data();
+        views[bound_idx].mapping_size = bound.mapping.size();
+        views[bound_idx].value = bound.value;
+      }
+    }
+
+    // Number of hardware threads, at least one
+    size_t HardwareConcurrency() {
+      return std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    // Returns the assembly workers for a number of threads, or null for a
+    // single thread. 0 threads uses the hardware concurrency. The pool is
+    // kept and rebuilt only when the number of threads changes.
+    ThreadPool* AcquireThreadPool(
+        size_t num_threads,
+        std::shared_ptr<ThreadPool>& thread_pool) {
+      if(0 == num_threads) {
+        num_threads = HardwareConcurrency();
+      }
+      if(num_threads <= 1) {
+        return nullptr;
+      }
+      if(nullptr == thread_pool || thread_pool->NumThreads() != num_threads) {
+        thread_pool = std::make_shared<ThreadPool>(num_threads);
+      }
+      return thread_pool.get();
+    }
+
+    // Problem handed to OSQP, along with what is needed to map its solution
+    // back
+    struct Assembly {
+      OSQPData* data = nullptr;
+      // Distance of the point of every row from the nearest endpoint of its
+      // segment. Null unless segment bounds are lazy.
+      c_int* row_sample_points = nullptr;
+      // Equilibration scale of every row. Null unless rows are equilibrated.
+      c_float* row_scales = nullptr;
+      // Null unless the node derivative formulation is used
+      std::unique_ptr<NodeDerivativeMap> node_derivative_map;
+      // Constraint matrix over the polynomial coefficients, which is the
+      // matrix handed to OSQP unless the node derivative formulation is
+      // used, and its column cursors. Null unless kept to rewrite the
+      // values for new times; see RewriteTimes.
+      csc* coefficient_constraints = nullptr;
+      c_int* column_cursors = nullptr;
+    };
+
+    // Assembles the problem handed to OSQP. The problem is allocated in the
+    // arena and intermediates in the scratch arena. With keep_pattern, the
+    // coefficient constraint matrix and its column cursors are kept in the
+    // arena so that RewriteTimes can update the values in place.
+    void Assemble(
+        const PolynomialSolver::Options& options,
+        const Constants& constants,
+        const PolynomialBasis& basis,
+        const std::vector<double>& times,
+        const ProblemBounds& bounds,
+        ThreadPool* thread_pool,
+        const bool keep_pattern,
+        Arena& arena,
+        Arena& scratch_arena,
+        Assembly& assembly) {
+      /*
+       * CONSTRAINTS
+       */
+      c_float* l = arena.Allocate<c_float>(constants.num_constraints);
+      c_float* u = arena.Allocate<c_float>(constants.num_constraints);
+
+      // Lazy segment bounds need the point of every row
+      c_int* row_sample_points = true == options.lazy_segment_bounds
+        ? arena.Allocate<c_int>(constants.num_constraints)
+        : nullptr;
+
+      c_float* row_scales = true == options.equilibrate_rows
+        ? arena.Allocate<c_float>(constants.num_constraints)
+        : nullptr;
+
+      c_int* column_cursors = true == keep_pattern
+        ? arena.Allocate<c_int>(3 * constants.total_num_params)
+        : nullptr;
+
+      csc* A = AssembleConstraints(
+          constants, 
+          basis,
+          times,
+          bounds,
+          l, 
+          u,
+          row_sample_points,
+          // The node derivative map mixes the alpha powers of a segment into
+          // every row, so its rows are equilibrated after mapping
+          Formulation::NODE_DERIVATIVES == options.formulation ? nullptr : row_scales,
+          column_cursors,
+          thread_pool,
+          Formulation::NODE_DERIVATIVES == options.formulation && false == keep_pattern ? scratch_arena : arena,
+          scratch_arena);
+      if(true == keep_pattern) {
+        assembly.coefficient_constraints = A;
+        assembly.column_cursors = column_cursors;
+      }
+
+      /*
+       * QUADRATIC MATRIX
+       */
+      csc* P = nullptr;
+      size_t num_variables = constants.total_num_params;
+      if(Formulation::NODE_DERIVATIVES == options.formulation) {
+        assembly.node_derivative_map.reset(new NodeDerivativeMap(
+              constants.layout,
+              constants.num_dimensions,
+              constants.polynomial_order,
+              constants.continuity_order,
+              basis,
+              times,
+              arena));
+
+        const size_t num_params = constants.num_params_per_segment_per_dim;
+        double* quadratic_matrix = scratch_arena.Allocate<double>(num_params * num_params);
+        basis.QuadraticMatrix(constants.derivative_order, quadratic_matrix);
+
+        // Unless kept, the coefficient constraint matrix was assembled in the
+        // scratch arena
+        A = assembly.node_derivative_map->MapConstraints(A, arena);
+        P = assembly.node_derivative_map->MapQuadraticCost(quadratic_matrix, arena);
+        num_variables = assembly.node_derivative_map->NumVariables();
+        if(nullptr != row_scales) {
+          NormalizeRows(A, l, u, row_scales);
+        }
+      } else {
+        P = SetQuadraticCost(constants, basis, thread_pool, arena, scratch_arena);
+      }
+
+      c_float* q = arena.Allocate<c_float>(num_variables);
+      std::fill(q, q + num_variables, 0);
+
+      OSQPData* data = arena.Allocate<OSQPData>(1);
+      data->n = num_variables;
+      data->m = constants.num_constraints;
+      data->P = P;
+      data->q = q;
+      data->A = A;
+      data->l = l;
+      data->u = u;
+
+      assembly.data = data;
+      assembly.row_sample_points = row_sample_points;
+      assembly.row_scales = row_scales;
+    }
+
+    // Whether two CSC matrices have the same dimensions and non-zero entries
+    bool SamePattern(
+        const csc* mat,
+        const csc* other) {
+      return 
+        mat->m == other->m &&
+        mat->n == other->n &&
+        std::equal(mat->p, mat->p + mat->n + 1, other->p) &&
+        std::equal(mat->i, mat->i + mat->p[mat->n], other->i);
+    }
+
+    // Rewrites the values of an assembly kept with keep_pattern for new
+    // times, in place. Only the entries of the constraint matrix, the bound
+    // vectors and, with the node derivative formulation, the quadratic cost
+    // depend on the times; the cost of the coefficient formulation does not.
+    // Returns false if the sparsity pattern changed, in which case the
+    // assembly is left inconsistent and must be assembled again.
+    // Intermediates are allocated in the scratch arena.
+    bool RewriteTimes(
         const Constants& constants,
+        const PolynomialBasis& basis,
         const std::vector<double>& times,
-        const std::vector<NodeEqualityBound>& explicit_node_equality_bounds, 
-        const std::vector<NodeInequalityBound>& explicit_node_inequality_bounds,
-        const std::vector<SegmentInequalityBound>& explicit_segment_inequality_bounds,
-        Eigen::MatrixXd& lower_bound_vec, 
-        Eigen::MatrixXd& upper_bound_vec,
-        std::vector<Eigen::Triplet<double>>& constraint_triplets
-        ) {
-      size_t constraint_idx = 0;
-      for(size_t dimension_idx = 0; dimension_idx < constants.num_dimensions; ++dimension_idx) { 
-        for(size_t node_idx = 0; node_idx < constants.num_nodes; ++node_idx) {
-          for(size_t derivative_idx = 0; derivative_idx < constants.num_params_per_segment_per_dim; ++derivative_idx) {
+        const ProblemBounds& bounds,
+        ThreadPool* thread_pool,
+        Arena& scratch_arena,
+        Assembly& assembly) {
+      OSQPData* data = assembly.data;
+      NodeDerivativeMap* node_derivative_map = assembly.node_derivative_map.get();
+      if(false == RewriteConstraints(
+            constants,
+            basis,
+            times,
+            bounds,
+            assembly.column_cursors,
+            assembly.coefficient_constraints,
+            data->l,
+            data->u,
+            nullptr == node_derivative_map ? assembly.row_scales : nullptr,
+            thread_pool,
+            scratch_arena)) {
+        return false;
+      }
+      if(nullptr == node_derivative_map) {
+        return true;
+      }
+
+      // The mapped matrices are mapped again and their values copied into
+      // the matrices handed to OSQP
+      node_derivative_map->UpdateTimes(times);
+      csc* A = node_derivative_map->MapConstraints(assembly.coefficient_constraints, scratch_arena);
+      const size_t num_params = constants.num_params_per_segment_per_dim;
+      double* quadratic_matrix = scratch_arena.Allocate<double>(num_params * num_params);
+      basis.QuadraticMatrix(constants.derivative_order, quadratic_matrix);
+      const csc* P = node_derivative_map->MapQuadraticCost(quadratic_matrix, scratch_arena);
+      if(false == SamePattern(A, data->A) || false == SamePattern(P, data->P)) {
+        return false;
+      }
+      if(nullptr != assembly.row_scales) {
+        NormalizeRows(A, data->l, data->u, assembly.row_scales);
+      }
+      std::copy(A->x, A->x + A->p[A->n], data->A->x);
+      std::copy(P->x, P->x + P->p[P->n], data->P->x);
+      return true;
+    }
+
+    // Predicts the peak memory of setting up and solving a problem. Under a
+    // memory budget, the assembly intermediates in the scratch arena must
+    // have been released.
+    size_t PredictRunMemory(
+        const PolynomialSolver::Options& options,
+        const OSQPData& data,
+        const Arena& arena,
+        const Arena& scratch_arena) {
+      return arena.Capacity() + scratch_arena.Capacity()
+        + PredictOsqpMemory(data, options.osqp_settings);
+    }
+
+    // Whether a predicted peak memory exceeds the memory budget
+    bool ExceedsBudget(
+        const PolynomialSolver::Options& options,
+        const size_t predicted_memory) {
+      return 0 != options.memory_budget && predicted_memory > options.memory_budget;
+    }
+
+    // Maps the duals of equilibrated rows back onto the rows as given. If
+    // row_map is not null, it holds the row of the workspace of every row,
+    // or -1 if the row was not handed to OSQP.
+    void UnscaleDuals(
+        const size_t num_constraints,
+        const c_float* row_scales,
+        const c_int* row_map,
+        c_float* y) {
+      for(size_t row = 0; row < num_constraints; ++row) {
+        const c_int workspace_row = nullptr != row_map ? row_map[row] : static_cast<c_int>(row);
+        if(-1 != workspace_row) {
+          y[workspace_row] *= row_scales[row];
+        }
+      }
+    }
+
+    // Full monomial coefficient vector given the variables of the solved
+    // problem. Null if the variables are the monomial coefficients and the
+    // workspace holds them.
+    std::shared_ptr<const std::vector<double>> MonomialCoefficients(
+        const Constants& constants,
+        const PolynomialBasis& basis,
+        const NodeDerivativeMap* node_derivative_map,
+        const bool in_workspace,
+        const double* variables,
+        const size_t num_variables) {
+      if(true == in_workspace && nullptr == node_derivative_map && Basis::MONOMIAL == basis.Type()) {
+        return nullptr;
+      }
+
+      std::shared_ptr<std::vector<double>> x 
+        = std::make_shared<std::vector<double>>(constants.total_num_params);
+      if(nullptr != node_derivative_map) {
+        node_derivative_map->Coefficients(variables, x->data());
+      } else {
+        std::copy(variables, variables + num_variables, x->begin());
+      }
+
+      if(Basis::MONOMIAL != basis.Type()) {
+        double block[kMaxPolynomialOrder + 1];
+        for(size_t block_idx = 0; block_idx < constants.layout.NumBlocks(); ++block_idx) {
+          const size_t num_params = constants.layout.BlockSize(block_idx);
+          double* coefficients = x->data() + constants.layout.BlockOffset(block_idx);
+          std::copy(coefficients, coefficients + num_params, block);
+          basis.ToMonomial(block, num_params, coefficients);
+        }
+      }
+      return x;
+    }
+
+    // Whether two bounds constrain the same rows with the same entries
+    bool SameStructure(const NodeEqualityBound& bound, const NodeEqualityBound& other) {
+      return 
+        bound.dimension_idx == other.dimension_idx &&
+        bound.node_idx == other.node_idx &&
+        bound.derivative_idx == other.derivative_idx;
+    }
+
+    bool SameStructure(const NodeInequalityBound& bound, const NodeInequalityBound& other) {
+      return 
+        bound.dimension_idx == other.dimension_idx &&
+        bound.node_idx == other.node_idx &&
+        bound.derivative_idx == other.derivative_idx;
+    }
+
+    bool SameStructure(const NodeRangeBound& bound, const NodeRangeBound& other) {
+      return 
+        bound.dimension_idx == other.dimension_idx &&
+        bound.node_begin == other.node_begin &&
+        bound.node_end == other.node_end &&
+        bound.derivative_idx == other.derivative_idx;
+    }
+
+    bool SameStructure(const NodeValuesBound& bound, const NodeValuesBound& other) {
+      return 
+        bound.dimension_begin == other.dimension_begin &&
+        bound.node_begin == other.node_begin &&
+        bound.derivative_idx == other.derivative_idx &&
+        bound.values.rows() == other.values.rows() &&
+        bound.values.cols() == other.values.cols();
+    }
+
+    bool SameStructure(const SegmentInequalityBound& bound, const SegmentInequalityBound& other) {
+      return 
+        bound.segment_idx == other.segment_idx &&
+        bound.derivative_idx == other.derivative_idx &&
+        bound.mapping.size() == other.mapping.size() &&
+        bound.mapping == other.mapping;
+    }
+
+    bool SameStructure(const SegmentBoxBound& bound, const SegmentBoxBound& other) {
+      return 
+        bound.dimension_idx == other.dimension_idx &&
+        bound.segment_idx == other.segment_idx &&
+        bound.derivative_idx == other.derivative_idx;
+    }
+
+    bool SameStructure(const SegmentPolytopeBound& bound, const SegmentPolytopeBound& other) {
+      const Eigen::SparseMatrix<double, Eigen::RowMajor>& faces = bound.faces;
+      const Eigen::SparseMatrix<double, Eigen::RowMajor>& other_faces = other.faces;
+      if(bound.segment_idx != other.segment_idx 
+          || bound.derivative_idx != other.derivative_idx
+          || faces.rows() != other_faces.rows()
+          || faces.cols() != other_faces.cols()
+          || faces.nonZeros() != other_faces.nonZeros()) {
+        return false;
+      }
+      // Faces are compressed on construction
+      return 
+        std::equal(faces.outerIndexPtr(), faces.outerIndexPtr() + faces.outerSize() + 1, other_faces.outerIndexPtr()) &&
+        std::equal(faces.innerIndexPtr(), faces.innerIndexPtr() + faces.nonZeros(), other_faces.innerIndexPtr()) &&
+        std::equal(faces.valuePtr(), faces.valuePtr() + faces.nonZeros(), other_faces.valuePtr());
+    }
+
+    bool SameStructure(const SegmentRangeBound& bound, const SegmentRangeBound& other) {
+      return 
+        bound.dimension_idx == other.dimension_idx &&
+        bound.segment_begin == other.segment_begin &&
+        bound.segment_end == other.segment_end &&
+        bound.derivative_idx == other.derivative_idx;
+    }
+
+    template <class Bound>
+    bool SameStructure(const std::vector<Bound>& bounds, const std::vector<Bound>& other) {
+      if(bounds.size() != other.size()) {
+        return false;
+      }
+      for(size_t bound_idx = 0; bound_idx < bounds.size(); ++bound_idx) {
+        if(false == SameStructure(bounds[bound_idx], other[bound_idx])) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // Fingerprint of everything the sparsity pattern of the assembled
+    // problem follows from: the structural options, the number of nodes and
+    // the indices of every bound. Mappings and faces only contribute their
+    // nonzero pattern. Values, limits and times do not contribute.
+    uint64_t StructureFingerprint(
+        const PolynomialSolver::Options& options,
+        const Constants& constants,
+        const ProblemBounds& bounds) {
+      StructureHash hash;
+      hash.Add(static_cast<uint64_t>(options.formulation));
+      hash.Add(static_cast<uint64_t>(options.basis));
+      hash.Add(static_cast<uint64_t>(options.variable_ordering));
+      hash.Add(static_cast<uint64_t>(options.segment_bound_points));
+      hash.Add(constants.num_dimensions);
+      hash.Add(constants.polynomial_order);
+      hash.Add(constants.derivative_order);
+      hash.Add(constants.continuity_order);
+      hash.Add(constants.num_intermediate_points);
+      hash.Add(constants.num_nodes);
+      hash.Add(options.segment_polynomial_orders.size());
+      for(const size_t order: options.segment_polynomial_orders) {
+        hash.Add(order);
+      }
+      hash.Add(options.dimension_polynomial_orders.size());
+      for(const size_t order: options.dimension_polynomial_orders) {
+        hash.Add(order);
+      }
+
+      hash.Add(bounds.node_equality_bounds.size());
+      for(const NodeEqualityBound& bound: bounds.node_equality_bounds) {
+        hash.Add(bound.dimension_idx);
+        hash.Add(bound.node_idx);
+        hash.Add(bound.derivative_idx);
+      }
+      hash.Add(bounds.node_inequality_bounds.size());
+      for(const NodeInequalityBound& bound: bounds.node_inequality_bounds) {
+        hash.Add(bound.dimension_idx);
+        hash.Add(bound.node_idx);
+        hash.Add(bound.derivative_idx);
+      }
+      hash.Add(bounds.node_range_bounds.size());
+      for(const NodeRangeBound& bound: bounds.node_range_bounds) {
+        hash.Add(bound.dimension_idx);
+        hash.Add(bound.node_begin);
+        hash.Add(bound.node_end);
+        hash.Add(bound.derivative_idx);
+      }
+      hash.Add(bounds.node_values_bounds.size());
+      for(const NodeValuesBound& bound: bounds.node_values_bounds) {
+        hash.Add(bound.dimension_begin);
+        hash.Add(bound.node_begin);
+        hash.Add(bound.derivative_idx);
+        hash.Add(bound.values.rows());
+        hash.Add(bound.values.cols());
+      }
+      hash.Add(bounds.num_segment_inequality_bounds);
+      for(size_t bound_idx = 0; bound_idx < bounds.num_segment_inequality_bounds; ++bound_idx) {
+        const SegmentBoundView& bound = bounds.segment_inequality_bounds[bound_idx];
+        hash.Add(bound.segment_idx);
+        hash.Add(bound.derivative_idx);
+        if(false == InRange(constants, bound)) {
+          continue;
+        }
+        for(size_t dimension_idx = 0; dimension_idx < constants.num_dimensions; ++dimension_idx) {
+          hash.Add(0 != bound.mapping[dimension_idx]);
+        }
+      }
+      hash.Add(bounds.segment_box_bounds.size());
+      for(const SegmentBoxBound& bound: bounds.segment_box_bounds) {
+        hash.Add(bound.dimension_idx);
+        hash.Add(bound.segment_idx);
+        hash.Add(bound.derivative_idx);
+      }
+      hash.Add(bounds.segment_polytope_bounds.size());
+      for(const SegmentPolytopeBound& bound: bounds.segment_polytope_bounds) {
+        const Eigen::SparseMatrix<double, Eigen::RowMajor>& faces = bound.faces;
+        hash.Add(bound.segment_idx);
+        hash.Add(bound.derivative_idx);
+        hash.Add(faces.rows());
+        hash.Add(faces.cols());
+        for(Eigen::Index row = 0; row < faces.outerSize(); ++row) {
+          for(Eigen::SparseMatrix<double, Eigen::RowMajor>::InnerIterator it(faces, row); it; ++it) {
+            if(0 != it.value()) {
+              hash.Add(row);
+              hash.Add(it.col());
+            }
+          }
+        }
+      }
+      hash.Add(bounds.segment_range_bounds.size());
+      for(const SegmentRangeBound& bound: bounds.segment_range_bounds) {
+        hash.Add(bound.dimension_idx);
+        hash.Add(bound.segment_begin);
+        hash.Add(bound.segment_end);
+        hash.Add(bound.derivative_idx);
+      }
+      return hash.Value();
+    }
 
-            // Equality Constraints
-            for(const NodeEqualityBound& bound: explicit_node_equality_bounds) {
-              if(
-                  false == (bound.node_idx == node_idx) ||
-                  false == (bound.dimension_idx == dimension_idx) || 
-                  false == (bound.derivative_idx == derivative_idx)) {
-                continue;
-              }
-              else {
-                const double alpha = node_idx+1 < constants.num_nodes ? (times[node_idx + 1] - times[node_idx]) : 1;
+    // Solution of a problem before it is solved
+    PolynomialSolver::Solution MakeSolution(const Constants& constants) {
+      PolynomialSolver::Solution solution;
+      solution.num_dimensions   = constants.num_dimensions;
+      solution.polynomial_order = constants.polynomial_order;
+      solution.num_nodes        = constants.num_nodes;
+      solution.layout           = constants.layout;
+      return solution;
+    }
 
-                // Bounds. Scaled by alpha. See documentation.
-                lower_bound_vec(constraint_idx,0) = bound.value * std::pow(alpha, derivative_idx);
-                upper_bound_vec(constraint_idx,0) = bound.value * std::pow(alpha, derivative_idx);
+    // Records the outcome of an OSQP solve. Iterations accumulate over the
+    // solves of a run.
+    void RecordSolve(
+        const OSQPWorkspace& workspace,
+        PolynomialSolver::Solution& solution) {
+      solution.osqp_status = workspace.info->status_val;
+      solution.objective = workspace.info->obj_val;
+      solution.iterations += workspace.info->iter;
+      switch(workspace.info->status_val) {
+        case OSQP_SOLVED:
+          solution.status = SolveStatus::SOLVED;
+          break;
+        case OSQP_SOLVED_INACCURATE:
+          solution.status = SolveStatus::SOLVED_INACCURATE;
+          break;
+        default:
+          solution.status = SolveStatus::UNSOLVED;
+          break;
+      }
+    }
 
-                // Constraints
-                size_t parameter_idx = 0 
-                  + derivative_idx 
-                  + constants.num_params_per_node_per_dim * node_idx
-                  + constants.num_params_per_node_per_dim * constants.num_nodes * dimension_idx;
-                constraint_triplets.emplace_back(constraint_idx, parameter_idx, 1);
+    // Severity of a status. A decoupled problem reports the most severe
+    // status of its groups.
+    int Severity(const SolveStatus status) {
+      switch(status) {
+        case SolveStatus::SOLVED:
+          return 0;
+        case SolveStatus::SOLVED_INACCURATE:
+          return 1;
+        default:
+          return 2;
+      }
+    }
 
-                constraint_idx++;
-              }
-            }
+    // Root of the set of a dimension. The root of a set is its smallest
+    // dimension.
+    size_t FindComponent(
+        std::vector<size_t>& parents,
+        size_t dimension_idx) {
+      while(parents[dimension_idx] != dimension_idx) {
+        parents[dimension_idx] = parents[parents[dimension_idx]];
+        dimension_idx = parents[dimension_idx];
+      }
+      return dimension_idx;
+    }
 
-            // Node inequality bound constraints
-            for(const NodeInequalityBound& bound: explicit_node_inequality_bounds) {
-              if(
-                  false == (bound.node_idx == node_idx) ||
-                  false == (bound.dimension_idx == dimension_idx) || 
-                  false == (bound.derivative_idx == derivative_idx)) {
-                continue;
-              }
-              else {
-                const double alpha = node_idx+1 < constants.num_nodes ? (times[node_idx + 1] - times[node_idx]) : 1;
+    void JoinComponents(
+        std::vector<size_t>& parents,
+        const size_t dimension_idx,
+        const size_t other_dimension_idx) {
+      const size_t root = FindComponent(parents, dimension_idx);
+      const size_t other_root = FindComponent(parents, other_dimension_idx);
+      parents[std::max(root, other_root)] = std::min(root, other_root);
+    }
 
-                // Bounds. Scaled by alpha. See documentation.
-                lower_bound_vec(constraint_idx,0) = bound.lower * std::pow(alpha, derivative_idx);
-                upper_bound_vec(constraint_idx,0) = bound.upper * std::pow(alpha, derivative_idx);
+    // Groups the dimensions into independent components. Every other bound
+    // and the cost only touch a single dimension, so dimensions are only
+    // coupled through the nonzero entries of segment inequality mappings
+    // and polytope faces. Writes the component of every dimension, numbered
+    // in the order of their smallest dimension, and returns the number of
+    // components.
+    size_t DimensionComponents(
+        const Constants& constants,
+        const ProblemBounds& bounds,
+        std::vector<size_t>& components) {
+      const size_t num_dimensions = constants.num_dimensions;
+      std::vector<size_t> parents(num_dimensions);
+      for(size_t dimension_idx = 0; dimension_idx < num_dimensions; ++dimension_idx) {
+        parents[dimension_idx] = dimension_idx;
+      }
 
-                // Constraints
-                size_t parameter_idx = 0 
-                  + derivative_idx 
-                  + constants.num_params_per_node_per_dim * node_idx
-                  + constants.num_params_per_node_per_dim * constants.num_nodes * dimension_idx;
-                constraint_triplets.emplace_back(constraint_idx, parameter_idx, 1);
+      for(size_t bound_idx = 0; bound_idx < bounds.num_segment_inequality_bounds; ++bound_idx) {
+        const SegmentBoundView& bound = bounds.segment_inequality_bounds[bound_idx];
+        if(false == InRange(constants, bound)) {
+          continue;
+        }
+        const double* mapping = bound.mapping;
+        size_t first_dimension_idx = num_dimensions;
+        for(size_t dimension_idx = 0; dimension_idx < num_dimensions; ++dimension_idx) {
+          if(0 == mapping[dimension_idx]) {
+            continue;
+          }
+          if(num_dimensions == first_dimension_idx) {
+            first_dimension_idx = dimension_idx;
+          } else {
+            JoinComponents(parents, first_dimension_idx, dimension_idx);
+          }
+        }
+      }
 
-                constraint_idx++;
-              }
+      for(const SegmentPolytopeBound& bound: bounds.segment_polytope_bounds) {
+        const Eigen::SparseMatrix<double, Eigen::RowMajor>& faces = bound.faces;
+        size_t first_dimension_idx = num_dimensions;
+        for(Eigen::Index row = 0; row < faces.outerSize(); ++row) {
+          for(Eigen::SparseMatrix<double, Eigen::RowMajor>::InnerIterator it(faces, row); it; ++it) {
+            const size_t dimension_idx = it.col();
+            if(0 == it.value() || dimension_idx >= num_dimensions) {
+              continue;
+            }
+            if(num_dimensions == first_dimension_idx) {
+              first_dimension_idx = dimension_idx;
+            } else {
+              JoinComponents(parents, first_dimension_idx, dimension_idx);
             }
           }
+        }
+      }
 
-          // Continuity constraints
-          if(node_idx < constants.num_segments) {
-            const size_t num_continuity_constraints = constants.continuity_order + 1;
-            constexpr double delta_t = 1.0;
-            const double alpha_k = times[node_idx + 1] - times[node_idx];
-            const double alpha_kp1 = node_idx + 2 < constants.num_nodes ? times[node_idx + 2] - times[node_idx + 1] : 1.0;
+      // Roots precede the other dimensions of their component
+      size_t num_components = 0;
+      components.resize(num_dimensions);
+      for(size_t dimension_idx = 0; dimension_idx < num_dimensions; ++dimension_idx) {
+        const size_t root = FindComponent(parents, dimension_idx);
+        components[dimension_idx] = root == dimension_idx ? num_components++ : components[root];
+      }
+      return num_components;
+    }
 
+    // Bounds of a component, in the dimensions of the component
+    struct ComponentBounds {
+      std::vector<NodeEqualityBound> node_equality_bounds;
+      std::vector<NodeInequalityBound> node_inequality_bounds;
+      std::vector<SegmentInequalityBound> segment_inequality_bounds;
+      std::vector<SegmentBoxBound> segment_box_bounds;
+      std::vector<SegmentPolytopeBound> segment_polytope_bounds;
+      std::vector<NodeRangeBound> node_range_bounds;
+      std::vector<NodeValuesBound> node_values_bounds;
+      std::vector<SegmentRangeBound> segment_range_bounds;
+    };
 
-            for(size_t continuity_idx = 0; continuity_idx < num_continuity_constraints; ++continuity_idx) {
-              // Bounds
-              lower_bound_vec(constraint_idx,0) = 0;
-              upper_bound_vec(constraint_idx,0) = 0;
+    // Component of a bound that touches no dimension, e.g. a segment
+    // inequality bound with a zero mapping. The bound is kept so that the
+    // component reports it if it cannot be met.
+    const size_t kDefaultComponent = 0;
 
-              // Constraints. Scaled by alpha. See documentation.
-              // Propagate the current node
-              Eigen::MatrixXd segment_propagation_coefficients;
-              segment_propagation_coefficients.resize(1, constants.num_params_per_segment_per_dim);
-              segment_propagation_coefficients.fill(0);
-              segment_propagation_coefficients 
-                = TimeVector(constants.polynomial_order, continuity_idx, delta_t).transpose()
-                / std::pow(alpha_k, continuity_idx);
-
-              // Minus the next node
-              Eigen::MatrixXd segment_terminal_coefficients;
-              segment_terminal_coefficients.resize(1, constants.num_params_per_segment_per_dim);
-              segment_terminal_coefficients.fill(0);
-              segment_terminal_coefficients(0,continuity_idx) = -1 / std::pow(alpha_kp1, continuity_idx);
-
-              size_t current_segment_idx = 0 
-                // Get to the right dimension
-                + constants.num_params_per_node_per_dim * constants.num_nodes * dimension_idx
-                // Get to the right node
-                + constants.num_params_per_node_per_dim * node_idx;
-              size_t next_segment_idx = 0
-                // Get to the right dimension
-                + constants.num_params_per_node_per_dim * constants.num_nodes * dimension_idx
-                // Get to the right node
-                + constants.num_params_per_node_per_dim * (node_idx + 1);
-
-              for(size_t param_idx = 0; param_idx < constants.num_params_per_segment_per_dim; ++param_idx) {
-                constraint_triplets.emplace_back(
-                    constraint_idx, 
-                    current_segment_idx + param_idx, 
-                    segment_propagation_coefficients(0, param_idx));
-                // TODO: Just insert one terminal constraint
-                constraint_triplets.emplace_back(
-                    constraint_idx, 
-                    next_segment_idx + param_idx, 
-                    segment_terminal_coefficients(0, param_idx));
-              }
+    // Splits the bounds over the components. Bounds outside of the problem
+    // are dropped; range bounds on every dimension are handed to
+    // every component.
+    void SplitBounds(
+        const Constants& constants,
+        const ProblemBounds& bounds,
+        const std::vector<size_t>& components,
+        const std::vector<size_t>& component_indices,
+        std::vector<ComponentBounds>& component_bounds) {
+      const size_t num_dimensions = constants.num_dimensions;
+
+      for(const NodeEqualityBound& bound: bounds.node_equality_bounds) {
+        if(bound.dimension_idx < num_dimensions) {
+          component_bounds[components[bound.dimension_idx]].node_equality_bounds.push_back(
+              NodeEqualityBound(
+                component_indices[bound.dimension_idx], 
+                bound.node_idx, 
+                bound.derivative_idx, 
+                bound.value));
+        }
+      }
 
-              constraint_idx++;
-            }
-          }
+      for(const NodeInequalityBound& bound: bounds.node_inequality_bounds) {
+        if(bound.dimension_idx < num_dimensions) {
+          component_bounds[components[bound.dimension_idx]].node_inequality_bounds.push_back(
+              NodeInequalityBound(
+                component_indices[bound.dimension_idx], 
+                bound.node_idx, 
+                bound.derivative_idx, 
+                bound.lower, 
+                bound.upper));
         }
       }
 
-      // Include start- and end-points in segment constraints. When constraining
-      // a segment, also constrain the endpoints of the segment to the same
-      // value. If this were not the case, the following situation could occur:
-      // the start endpoint is constrained to -2, but the following segment is
-      // constrained above zero. Clearly, there is no smooth solution that
-      // permits this. 
-      // 
-      // Add two to account for the endpoints and then remove one to convert
-      // from the number of points the the number of segments. Divide the
-      // segment length (1) by the number of segments to get the length of each
-      // intermediate segment.
-      const double dt = 1.0 / (constants.num_intermediate_points + 2 - 1);
+      for(const NodeRangeBound& bound: bounds.node_range_bounds) {
+        if(NodeRangeBound::ALL == bound.dimension_idx) {
+          for(ComponentBounds& component: component_bounds) {
+            component.node_range_bounds.push_back(bound);
+          }
+        } else if(bound.dimension_idx < num_dimensions) {
+          component_bounds[components[bound.dimension_idx]].node_range_bounds.push_back(
+              NodeRangeBound(
+                component_indices[bound.dimension_idx], 
+                bound.node_begin, 
+                bound.node_end, 
+                bound.derivative_idx, 
+                bound.lower, 
+                bound.upper));
+        }
+      }
 
-      // Segment lower bound constraints
-      for(const SegmentInequalityBound& bound: explicit_segment_inequality_bounds) {
-        const double alpha = times[bound.segment_idx+1] - times[bound.segment_idx];
+      // One bound per row, each on a single dimension
+      for(const NodeValuesBound& bound: bounds.node_values_bounds) {
+        for(Eigen::Index row = 0; row < bound.values.rows(); ++row) {
+          const size_t dimension_idx = bound.dimension_begin + row;
+          if(dimension_idx < num_dimensions) {
+            component_bounds[components[dimension_idx]].node_values_bounds.push_back(
+                NodeValuesBound(
+                  component_indices[dimension_idx], 
+                  bound.node_begin, 
+                  bound.derivative_idx, 
+                  bound.values.row(row)));
+          }
+        }
+      }
 
-        // point_idx == intermediate_point_idx
-        // Add 2 for start and end points
-        for(size_t point_idx = 0; point_idx < constants.num_intermediate_points+2; ++point_idx)  {
-          // Bounds
-          lower_bound_vec(constraint_idx,0) = -SegmentInequalityBound::INFTY;
-          upper_bound_vec(constraint_idx,0) = bound.value * std::pow(alpha, bound.derivative_idx);
+      for(size_t bound_idx = 0; bound_idx < bounds.num_segment_inequality_bounds; ++bound_idx) {
+        const SegmentBoundView& bound = bounds.segment_inequality_bounds[bound_idx];
+        if(false == InRange(constants, bound)) {
+          continue;
+        }
+        size_t component_idx = kDefaultComponent;
+        for(size_t dimension_idx = 0; dimension_idx < num_dimensions; ++dimension_idx) {
+          if(0 != bound.mapping[dimension_idx]) {
+            component_idx = components[dimension_idx];
+            break;
+          }
+        }
 
-          // Time at a specific point
-          double time = point_idx * dt;
+        std::vector<SegmentInequalityBound>& component_segment_inequality_bounds 
+          = component_bounds[component_idx].segment_inequality_bounds;
+        size_t num_component_dimensions = 0;
+        for(size_t dimension_idx = 0; dimension_idx < num_dimensions; ++dimension_idx) {
+          num_component_dimensions += component_idx == components[dimension_idx];
+        }
+        Eigen::VectorXd mapping = Eigen::VectorXd::Zero(num_component_dimensions);
+        for(size_t dimension_idx = 0; dimension_idx < num_dimensions; ++dimension_idx) {
+          if(component_idx == components[dimension_idx]) {
+            mapping(component_indices[dimension_idx]) = bound.mapping[dimension_idx];
+          }
+        }
+        component_segment_inequality_bounds.push_back(
+            SegmentInequalityBound(bound.segment_idx, bound.derivative_idx, mapping, bound.value));
+      }
 
-          Eigen::MatrixXd segment_propagation_coefficients;
-          segment_propagation_coefficients.resize(1, constants.num_params_per_segment_per_dim);
-          segment_propagation_coefficients.fill(0);
-          segment_propagation_coefficients 
-            = TimeVector(constants.polynomial_order, bound.derivative_idx, time).transpose();
+      for(const SegmentBoxBound& bound: bounds.segment_box_bounds) {
+        if(bound.dimension_idx < num_dimensions) {
+          component_bounds[components[bound.dimension_idx]].segment_box_bounds.push_back(
+              SegmentBoxBound(
+                component_indices[bound.dimension_idx], 
+                bound.segment_idx, 
+                bound.derivative_idx, 
+                bound.lower, 
+                bound.upper));
+        }
+      }
 
-          for(size_t dimension_idx = 0; dimension_idx < constants.num_dimensions; ++dimension_idx) {
-            Eigen::MatrixXd transform_coefficients;
-            transform_coefficients.resize(1, constants.num_params_per_segment_per_dim);
-            transform_coefficients.fill(0);
-            transform_coefficients = bound.mapping(dimension_idx, 0) 
-              * segment_propagation_coefficients;
-
-            size_t current_segment_idx = 0 
-              // Get to the right dimension
-              + constants.num_params_per_node_per_dim * constants.num_nodes * dimension_idx
-              // Get to the right node
-              + constants.num_params_per_segment_per_dim * bound.segment_idx;
-
-            for(size_t param_idx = 0; param_idx < constants.num_params_per_segment_per_dim; ++param_idx) {
-              constraint_triplets.emplace_back(
-                  constraint_idx, 
-                  current_segment_idx + param_idx, 
-                  transform_coefficients(0, param_idx));
+      for(const SegmentPolytopeBound& bound: bounds.segment_polytope_bounds) {
+        const Eigen::SparseMatrix<double, Eigen::RowMajor>& faces = bound.faces;
+        size_t component_idx = kDefaultComponent;
+        std::vector<Eigen::Triplet<double>> entries;
+        for(Eigen::Index row = 0; row < faces.outerSize(); ++row) {
+          for(Eigen::SparseMatrix<double, Eigen::RowMajor>::InnerIterator it(faces, row); it; ++it) {
+            const size_t dimension_idx = it.col();
+            if(0 != it.value() && dimension_idx < num_dimensions) {
+              component_idx = components[dimension_idx];
+              entries.push_back(Eigen::Triplet<double>(row, component_indices[dimension_idx], it.value()));
             }
           }
+        }
+
+        size_t num_component_dimensions = 0;
+        for(size_t dimension_idx = 0; dimension_idx < num_dimensions; ++dimension_idx) {
+          num_component_dimensions += component_idx == components[dimension_idx];
+        }
+        Eigen::SparseMatrix<double, Eigen::RowMajor> component_faces(faces.rows(), num_component_dimensions);
+        component_faces.setFromTriplets(entries.begin(), entries.end());
+        component_bounds[component_idx].segment_polytope_bounds.push_back(
+            SegmentPolytopeBound(bound.segment_idx, bound.derivative_idx, component_faces, bound.offsets));
+      }
 
-          constraint_idx++;
+      for(const SegmentRangeBound& bound: bounds.segment_range_bounds) {
+        if(SegmentRangeBound::ALL == bound.dimension_idx) {
+          for(ComponentBounds& component: component_bounds) {
+            component.segment_range_bounds.push_back(bound);
+          }
+        } else if(bound.dimension_idx < num_dimensions) {
+          component_bounds[components[bound.dimension_idx]].segment_range_bounds.push_back(
+              SegmentRangeBound(
+                component_indices[bound.dimension_idx], 
+                bound.segment_begin, 
+                bound.segment_end, 
+                bound.derivative_idx, 
+                bound.lower, 
+                bound.upper));
         }
       }
     }
 
-    void SetQuadraticCost(
+    // Solves every component as a problem of its own, concurrently on the
+    // thread pool, and stitches the coefficients of the components into the
+    // solution
+    void SolveComponents(
+        const PolynomialSolver::Options& options,
         const Constants& constants,
-        std::vector<Eigen::Triplet<double>>& quadratic_triplets) {
-      const double delta_t = 1.0;
-      const Eigen::MatrixXd quadratic_matrix = QuadraticMatrix(constants.polynomial_order, constants.derivative_order, delta_t);
-
-      for(size_t dimension_idx = 0; dimension_idx < constants.num_dimensions; ++dimension_idx) {
-        // No cost for final node
-        for(size_t node_idx = 0; node_idx < constants.num_nodes - 1; ++node_idx) {
-          const size_t parameter_idx = 0
-            // Get to the right dimension
-            + constants.num_params_per_node_per_dim * constants.num_nodes * dimension_idx
-            // Get to the right node
-            + constants.num_params_per_node_per_dim * node_idx;
-          for(size_t row = 0; row < constants.num_params_per_node_per_dim; ++row) {
-            for(size_t col = 0; col < constants.num_params_per_node_per_dim; ++col) { 
-              quadratic_triplets.emplace_back(
-                  row + parameter_idx, 
-                  col + parameter_idx, 
-                  quadratic_matrix(row,col)
-                  );
-            }
-          }
-        }
-      }
-    }
-
-    // Converts an en eigen sparse matrix into an OSQP sparse matrix
-    // Reference: https://github.com/robotology/osqp-eigen
-    void Eigen2OSQP(
-        const Eigen::SparseMatrix<double> eigen_sparse_mat,
-        csc*& osqp_mat) {
-
-      // get number of row, columns and nonZeros from Eigen SparseMatrix
-      c_int rows   = eigen_sparse_mat.rows();
-      c_int cols   = eigen_sparse_mat.cols();
-      c_int num_nz = eigen_sparse_mat.nonZeros();
-    
-      // get inner and outer index
-      const int* innerIndexPtr    = eigen_sparse_mat.innerIndexPtr();
-      const int* outerIndexPtr    = eigen_sparse_mat.outerIndexPtr();
-      const int* innerNonZerosPtr = eigen_sparse_mat.innerNonZeroPtr();
-    
-      // get nonzero values
-      const double* valuePtr = eigen_sparse_mat.valuePtr();
-    
-      // Allocate memory for csc matrix
-      if(osqp_mat != nullptr){
-        std::cerr << "osqp_mat pointer is not a null pointer! " << std::endl;
-        std::exit(EXIT_FAILURE);
+        const std::vector<double>& times,
+        const ProblemBounds& bounds,
+        const std::vector<size_t>& components,
+        const size_t num_components,
+        const bool predict_only,
+        ThreadPool* thread_pool,
+        PolynomialSolver::Solution& solution) {
+      const size_t num_dimensions = constants.num_dimensions;
+
+      // Index of every dimension within its component
+      std::vector<std::vector<size_t>> component_dimensions(num_components);
+      std::vector<size_t> component_indices(num_dimensions);
+      for(size_t dimension_idx = 0; dimension_idx < num_dimensions; ++dimension_idx) {
+        std::vector<size_t>& dimensions = component_dimensions[components[dimension_idx]];
+        component_indices[dimension_idx] = dimensions.size();
+        dimensions.push_back(dimension_idx);
       }
-    
-      osqp_mat = csc_spalloc(rows, cols, num_nz, 1, 0);
-    
-      int innerOsqpPosition = 0;
-      for(int k = 0; k < cols; ++k) {
-          if (eigen_sparse_mat.isCompressed()) {
-              osqp_mat->p[k] = static_cast<c_int>(outerIndexPtr[k]);
-          } else {
-              if (k == 0) {
-                  osqp_mat->p[k] = 0;
-              } else {
-                  osqp_mat->p[k] = osqp_mat->p[k-1] + innerNonZerosPtr[k-1];
-              }
+
+      std::vector<ComponentBounds> component_bounds(num_components);
+      SplitBounds(constants, bounds, components, component_indices, component_bounds);
+
+      std::vector<PolynomialSolver::Solution> component_solutions(num_components);
+      RunTasks(thread_pool, num_components, [&](const size_t component_idx) {
+        const std::vector<size_t>& dimensions = component_dimensions[component_idx];
+        PolynomialSolver::Options component_options = options;
+        component_options.num_dimensions = dimensions.size();
+        component_options.num_threads = 1;
+        component_options.decouple_dimensions = false;
+        // The bounds of the whole problem have been checked
+        component_options.check_bounds = false;
+        if(false == options.dimension_polynomial_orders.empty()) {
+          component_options.dimension_polynomial_orders.clear();
+          for(const size_t dimension_idx: dimensions) {
+            component_options.dimension_polynomial_orders.push_back(
+                options.dimension_polynomial_orders[dimension_idx]);
           }
-          for (typename Eigen::SparseMatrix<double>::InnerIterator it(eigen_sparse_mat,k); it; ++it) {
-              osqp_mat->i[innerOsqpPosition] = static_cast<c_int>(it.row());
-              osqp_mat->x[innerOsqpPosition] = static_cast<c_float>(it.value());
-              innerOsqpPosition++;
+        }
+
+        const ComponentBounds& component = component_bounds[component_idx];
+        PolynomialSolver component_solver(component_options);
+        if(true == predict_only) {
+          component_solutions[component_idx].predicted_peak_memory = component_solver.PredictPeakMemory(
+              times,
+              component.node_equality_bounds,
+              component.node_inequality_bounds,
+              component.segment_inequality_bounds,
+              component.segment_box_bounds,
+              component.segment_polytope_bounds,
+              component.node_range_bounds,
+              component.node_values_bounds,
+              component.segment_range_bounds);
+          return;
+        }
+        component_solutions[component_idx] = component_solver.Run(
+            times,
+            component.node_equality_bounds,
+            component.node_inequality_bounds,
+            component.segment_inequality_bounds,
+            component.segment_box_bounds,
+            component.segment_polytope_bounds,
+            component.node_range_bounds,
+            component.node_values_bounds,
+            component.segment_range_bounds);
+      });
+
+      if(true == predict_only) {
+        for(const PolynomialSolver::Solution& component_solution: component_solutions) {
+          solution.predicted_peak_memory += component_solution.predicted_peak_memory;
+        }
+        return;
+      }
+
+      std::shared_ptr<std::vector<double>> x 
+        = std::make_shared<std::vector<double>>(constants.layout.Size(), 0);
+      for(size_t component_idx = 0; component_idx < num_components; ++component_idx) {
+        const PolynomialSolver::Solution& component_solution = component_solutions[component_idx];
+        const std::vector<size_t>& dimensions = component_dimensions[component_idx];
+        for(size_t component_dimension_idx = 0; component_dimension_idx < dimensions.size(); ++component_dimension_idx) {
+          const size_t dimension_idx = dimensions[component_dimension_idx];
+          for(size_t segment_idx = 0; segment_idx < constants.num_segments; ++segment_idx) {
+            const size_t num_coefficients = constants.layout.NumCoefficients(dimension_idx, segment_idx);
+            for(size_t coefficient_idx = 0; coefficient_idx < num_coefficients; ++coefficient_idx) {
+              (*x)[constants.layout.Index(dimension_idx, segment_idx, coefficient_idx)] 
+                = component_solution.Coefficient(component_dimension_idx, segment_idx, coefficient_idx);
+            }
           }
+        }
+        solution.component_workspaces.push_back(component_solution.workspace);
+        solution.predicted_peak_memory += component_solution.predicted_peak_memory;
+        solution.objective += component_solution.objective;
+        solution.iterations += component_solution.iterations;
+        if(0 == component_idx || Severity(component_solution.status) > Severity(solution.status)) {
+          solution.status = component_solution.status;
+          solution.osqp_status = component_solution.osqp_status;
+        }
+        solution.solved_directly = (0 == component_idx || true == solution.solved_directly)
+          && true == component_solution.solved_directly;
       }
-      osqp_mat->p[static_cast<int>(cols)] = static_cast<c_int>(innerOsqpPosition);
+      solution.x = x;
+      solution.component_dimensions = std::move(component_dimensions);
     }
   }
 
@@ -344,171 +3175,810 @@ namespace p4 {
       const std::vector<double>& times,
       const std::vector<NodeEqualityBound>& explicit_node_equality_bounds,
       const std::vector<NodeInequalityBound>& explicit_node_inequality_bounds,
-      const std::vector<SegmentInequalityBound>& explicit_segment_inequality_bounds) {
+      const std::vector<SegmentInequalityBound>& explicit_segment_inequality_bounds,
+      const std::vector<SegmentBoxBound>& explicit_segment_box_bounds,
+      const std::vector<SegmentPolytopeBound>& explicit_segment_polytope_bounds,
+      const std::vector<NodeRangeBound>& node_range_bounds,
+      const std::vector<NodeValuesBound>& node_values_bounds,
+      const std::vector<SegmentRangeBound>& segment_range_bounds) {
+    const ProblemBounds bounds = this->ViewBounds(
+        explicit_node_equality_bounds, 
+        explicit_node_inequality_bounds, 
+        explicit_segment_inequality_bounds,
+        explicit_segment_box_bounds,
+        explicit_segment_polytope_bounds,
+        node_range_bounds,
+        node_values_bounds,
+        segment_range_bounds);
+    return this->Solve(times, bounds);
+  }
+
+  size_t PolynomialSolver::PredictPeakMemory(
+      const std::vector<double>& times,
+      const std::vector<NodeEqualityBound>& explicit_node_equality_bounds,
+      const std::vector<NodeInequalityBound>& explicit_node_inequality_bounds,
+      const std::vector<SegmentInequalityBound>& explicit_segment_inequality_bounds,
+      const std::vector<SegmentBoxBound>& explicit_segment_box_bounds,
+      const std::vector<SegmentPolytopeBound>& explicit_segment_polytope_bounds,
+      const std::vector<NodeRangeBound>& node_range_bounds,
+      const std::vector<NodeValuesBound>& node_values_bounds,
+      const std::vector<SegmentRangeBound>& segment_range_bounds) {
+    const ProblemBounds bounds = this->ViewBounds(
+        explicit_node_equality_bounds, 
+        explicit_node_inequality_bounds, 
+        explicit_segment_inequality_bounds,
+        explicit_segment_box_bounds,
+        explicit_segment_polytope_bounds,
+        node_range_bounds,
+        node_values_bounds,
+        segment_range_bounds);
+    return this->Solve(times, bounds, true).predicted_peak_memory;
+  }
+
+  ProblemBounds PolynomialSolver::ViewBounds(
+      const std::vector<NodeEqualityBound>& explicit_node_equality_bounds,
+      const std::vector<NodeInequalityBound>& explicit_node_inequality_bounds,
+      const std::vector<SegmentInequalityBound>& explicit_segment_inequality_bounds,
+      const std::vector<SegmentBoxBound>& explicit_segment_box_bounds,
+      const std::vector<SegmentPolytopeBound>& explicit_segment_polytope_bounds,
+      const std::vector<NodeRangeBound>& node_range_bounds,
+      const std::vector<NodeValuesBound>& node_values_bounds,
+      const std::vector<SegmentRangeBound>& segment_range_bounds) {
+    // Every per-run buffer lives in the arena. OSQP copies the problem data
+    // during setup, so the buffers are recycled on the next run.
+    this->arena_.Reset();
+
+    SegmentBoundView* segment_bound_views 
+      = this->arena_.Allocate<SegmentBoundView>(explicit_segment_inequality_bounds.size());
+    ViewSegmentBounds(this->options_, explicit_segment_inequality_bounds, segment_bound_views);
+
+    const ProblemBounds bounds = {
+      explicit_node_equality_bounds, 
+      explicit_node_inequality_bounds, 
+      segment_bound_views, 
+      explicit_segment_inequality_bounds.size(),
+      explicit_segment_box_bounds,
+      explicit_segment_polytope_bounds,
+      node_range_bounds,
+      node_values_bounds,
+      segment_range_bounds
+    };
+    return bounds;
+  }
+
+  PolynomialSolver::Solution PolynomialSolver::Solve(
+      const std::vector<double>& times,
+      const ProblemBounds& bounds,
+      const bool predict_only) {
 
     this->options_.Check();
 
-    if(times.size() < 2) {
-      std::cerr << "PolynomialSolver::Run -- Time vector must have a size greater than one." << std::endl;
-      std::exit(EXIT_FAILURE);
+    const Constants constants = MakeConstants(this->options_, times, bounds);
+    PolynomialSolver::Solution solution = MakeSolution(constants);
+
+    // Buffers only needed until the problem is handed to OSQP
+    this->scratch_arena_.Reset();
+
+    if(true == this->options_.check_bounds) {
+      solution.diagnostic = CheckBounds(constants, times, bounds, this->scratch_arena_);
+      if(false == solution.diagnostic.Ok()) {
+        solution.status = SolveStatus::BOUND_CONFLICT;
+        return solution;
+      }
     }
 
-    Constants constants;
-    constants.num_dimensions = this->options_.num_dimensions;
-    constants.polynomial_order = this->options_.polynomial_order;
-    constants.derivative_order = this->options_.derivative_order;
-    constants.continuity_order = this->options_.continuity_order;
-    constants.num_intermediate_points = this->options_.num_intermediate_points;
-    constants.num_nodes = times.size();
-    constants.num_segments = constants.num_nodes - 1;
-    constants.num_params_per_node_per_dim = constants.polynomial_order + 1;
-    constants.num_params_per_segment_per_dim = constants.polynomial_order + 1;
-    constants.num_params_per_node = constants.num_dimensions * constants.num_params_per_node_per_dim;
-    constants.num_params_per_segment = constants.num_dimensions * constants.num_params_per_segment_per_dim;
-    constants.total_num_params = constants.num_params_per_node * constants.num_nodes;
-
-    // Explicit constraints are provided
-    const size_t num_explicit_constraints = 0
-      + explicit_node_equality_bounds.size() 
-      + explicit_node_inequality_bounds.size() 
-      + explicit_segment_inequality_bounds.size() * (constants.num_intermediate_points+2);
-
-    // Implicit constraints are continuity constraints
-    const size_t num_implicit_constraints = constants.num_segments*(constants.continuity_order+1)*constants.num_dimensions;
-
-    constants.num_constraints = num_explicit_constraints + num_implicit_constraints;
+    if(true == this->options_.decouple_dimensions) {
+      std::vector<size_t> components;
+      const size_t num_components = DimensionComponents(constants, bounds, components);
+      if(num_components > 1) {
+        // Groups are independent OSQP runs. The hardware threads beyond
+        // one per group would idle.
+        const size_t num_threads = 0 == this->options_.num_threads
+          ? std::min(num_components, HardwareConcurrency())
+          : this->options_.num_threads;
+        SolveComponents(
+            this->options_, 
+            constants, 
+            times, 
+            bounds, 
+            components, 
+            num_components, 
+            predict_only,
+            AcquireThreadPool(num_threads, this->thread_pool_), 
+            solution);
+        return solution;
+      }
+    }
 
-    /*
-     * CONSTRAINTS
-     */
-    Eigen::MatrixXd lower_bound_vec, upper_bound_vec;
-    lower_bound_vec.resize(constants.num_constraints, 1);
-    upper_bound_vec.resize(constants.num_constraints, 1);
+    ThreadPool* thread_pool = AcquireThreadPool(this->options_.num_threads, this->thread_pool_);
+
+    const PolynomialBasis basis(this->options_.basis, constants.polynomial_order);
 
-    std::vector<Eigen::Triplet<double>> constraint_triplets;
-    SetConstraints(
-        constants, 
+    Assembly assembly;
+    Assemble(
+        this->options_,
+        constants,
+        basis,
         times,
-        explicit_node_equality_bounds,
-        explicit_node_inequality_bounds,
-        explicit_segment_inequality_bounds,
-        lower_bound_vec, 
-        upper_bound_vec, 
-        constraint_triplets);
-
-    // Triplets to sparse mat
-    Eigen::SparseMatrix<double> sparse_constraint_mat(
-        constants.num_constraints, 
-        constants.total_num_params);
-    sparse_constraint_mat.setFromTriplets(
-        constraint_triplets.begin(), 
-        constraint_triplets.end());
+        bounds,
+        thread_pool,
+        false,
+        this->arena_,
+        this->scratch_arena_,
+        assembly);
 
     /*
-     * QUADRATIC MATRIX
+     * RUN THE SOLVER
      */
-    std::vector<Eigen::Triplet<double>> quadratic_triplets;
-    SetQuadraticCost(constants, quadratic_triplets);
+    OSQPData* data = assembly.data;
+    const size_t num_variables = data->n;
 
-    // Triplets to sparse mat
-    Eigen::SparseMatrix<double> sparse_quadratic_mat(
-        constants.total_num_params, 
-        constants.total_num_params);
-    sparse_quadratic_mat.setFromTriplets(
-        quadratic_triplets.begin(), 
-        quadratic_triplets.end());
+    /*
+     * DIRECT SOLVE
+     */
+    // The workspace then stays null
+    if(true == this->options_.direct_equality_solve
+        && false == predict_only
+        && 0 == this->options_.memory_budget
+        && true == DirectSolver::Applicable(*data)) {
+      DirectSolver direct_solver;
+      if(true == direct_solver.Solve(*data, this->options_.osqp_settings, this->scratch_arena_)) {
+        solution.solved_directly = true;
+        solution.status = SolveStatus::SOLVED;
+        solution.objective = direct_solver.Objective();
+        solution.x = MonomialCoefficients(
+            constants, basis, assembly.node_derivative_map.get(), false, direct_solver.X(), num_variables);
+        // There is no workspace to hold the duals
+        std::shared_ptr<std::vector<double>> y 
+          = std::make_shared<std::vector<double>>(direct_solver.Y(), direct_solver.Y() + data->m);
+        if(nullptr != assembly.row_scales) {
+          UnscaleDuals(constants.num_constraints, assembly.row_scales, nullptr, y->data());
+        }
+        solution.y = y;
+        return solution;
+      }
+    }
+    const c_int* row_sample_points = assembly.row_sample_points;
+    const c_float* row_scales = assembly.row_scales;
+
+    // Assembly intermediates are released before OSQP allocates its
+    // workspace when memory is budgeted. From here on, the scratch arena
+    // holds the buffers of a single solve and is reset before every solve.
+    if(0 != this->options_.memory_budget) {
+      this->scratch_arena_.Release();
+    }
 
     /*
-     * CONVERT EIGEN TO OSQP
+     * LAZY SEGMENT BOUNDS
      */
-    csc* P = nullptr;
-    csc* A = nullptr;
+    // Rows handed to OSQP. The first solve only includes the endpoint rows
+    // of every segment bound, along with every node bound and continuity
+    // row. Null if every row is handed to OSQP.
+    uint8_t* active_rows = nullptr;
+    double* row_values = nullptr;
+    c_int* row_map = nullptr;
+    // Duals of the previous solve on every row, in the units of the problem
+    // handed to OSQP. Rows that were not handed to OSQP have zero duals.
+    c_float* row_duals = nullptr;
+    if(nullptr != row_sample_points) {
+      active_rows = this->arena_.Allocate<uint8_t>(constants.num_constraints);
+      row_values = this->arena_.Allocate<double>(constants.num_constraints);
+      row_map = this->arena_.Allocate<c_int>(constants.num_constraints);
+      row_duals = this->arena_.Allocate<c_float>(constants.num_constraints);
+      for(size_t row = 0; row < constants.num_constraints; ++row) {
+        active_rows[row] = -1 == row_sample_points[row] || 0 == row_sample_points[row];
+      }
+    }
+
+    double* variables = this->arena_.Allocate<double>(num_variables);
+    c_float* warm_start = this->arena_.Allocate<c_float>(num_variables);
+    bool presolved = false;
+    for(size_t iteration = 0; ; ++iteration) {
+      // The buffers of the previous solve are no longer needed
+      this->scratch_arena_.Reset();
+      const bool previously_presolved = presolved;
+
+      OSQPData* iteration_data = data;
+      if(nullptr != active_rows) {
+        // The final solve includes every row. A prediction covers the
+        // final solve.
+        if(iteration + 1 == this->options_.max_lazy_iterations || true == predict_only) {
+          std::fill(active_rows, active_rows + constants.num_constraints, 1);
+        }
+
+        size_t num_active_rows = 0;
+        for(size_t row = 0; row < constants.num_constraints; ++row) {
+          row_map[row] = 0 != active_rows[row] ? num_active_rows++ : -1;
+        }
 
-    Eigen2OSQP(sparse_quadratic_mat, P);
-    Eigen2OSQP(sparse_constraint_mat, A);
+        iteration_data = this->scratch_arena_.Allocate<OSQPData>(1);
+        *iteration_data = *data;
+        iteration_data->m = num_active_rows;
+        iteration_data->A = SelectRows(data->A, row_map, num_active_rows, this->scratch_arena_);
+        iteration_data->l = this->scratch_arena_.Allocate<c_float>(num_active_rows);
+        iteration_data->u = this->scratch_arena_.Allocate<c_float>(num_active_rows);
+        for(size_t row = 0; row < constants.num_constraints; ++row) {
+          if(-1 != row_map[row]) {
+            iteration_data->l[row_map[row]] = data->l[row];
+            iteration_data->u[row_map[row]] = data->u[row];
+          }
+        }
+      }
+
+      /*
+       * PRESOLVE
+       */
+      Presolver presolver;
+      presolved 
+        = true == this->options_.presolve && true == presolver.Run(*iteration_data, this->scratch_arena_);
+
+      // The previous workspace is no longer needed; the solution has been
+      // copied out
+      solution.workspace.reset();
+
+      // Assembly intermediates are released before OSQP allocates its
+      // workspace when memory is budgeted
+      OSQPData* setup_data = true == presolved ? presolver.ReducedData() : iteration_data;
+      solution.predicted_peak_memory = std::max(
+          solution.predicted_peak_memory,
+          PredictRunMemory(this->options_, *setup_data, this->arena_, this->scratch_arena_));
+      // A prediction, or a run over its budget, stops before OSQP is set up
+      if(true == predict_only || true == ExceedsBudget(this->options_, solution.predicted_peak_memory)) {
+        if(false == predict_only) {
+          solution.status = SolveStatus::MEMORY_BUDGET_EXCEEDED;
+        }
+        if(0 != this->options_.memory_budget) {
+          this->arena_.Release();
+          this->scratch_arena_.Release();
+        }
+        return solution;
+      }
+
+      if(true == this->options_.cache_workspaces) {
+        solution.workspace = WorkspaceCache::Instance()->Acquire(
+            StructureFingerprint(this->options_, constants, bounds),
+            setup_data,
+            &this->options_.osqp_settings);
+      } else {
+        solution.workspace =  std::shared_ptr<OSQPWorkspace>(
+            osqp_setup(setup_data, &this->options_.osqp_settings),
+            [](OSQPWorkspace* workspace) { 
+              osqp_cleanup(workspace);
+            });
+      }
+
+      // Start from the previous solution, which only misses the rows added
+      // since. Rows that stay active keep their duals and added rows start
+      // from zero. The rows of a presolved problem are not the rows as
+      // given, so only its primal solution is carried over.
+      if(iteration > 0) {
+        if(true == presolved) {
+          presolver.Reduce(variables, warm_start);
+        } else {
+          std::copy(variables, variables + num_variables, warm_start);
+        }
+        if(false == presolved && false == previously_presolved) {
+          c_float* warm_start_duals = this->scratch_arena_.Allocate<c_float>(iteration_data->m);
+          for(size_t row = 0; row < constants.num_constraints; ++row) {
+            if(-1 != row_map[row]) {
+              warm_start_duals[row_map[row]] = row_duals[row];
+            }
+          }
+          osqp_warm_start(solution.workspace.get(), warm_start, warm_start_duals);
+        } else {
+          osqp_warm_start_x(solution.workspace.get(), warm_start);
+        }
+      }
+
+      // Solve
+      osqp_solve(solution.workspace.get());
+
+      if(true == presolved) {
+        presolver.Restore(solution.workspace->solution->x, variables);
+        solution.workspace->info->obj_val += presolver.ObjectiveOffset();
+      } else {
+        std::copy(
+            solution.workspace->solution->x, 
+            solution.workspace->solution->x + num_variables, 
+            variables);
+      }
+      RecordSolve(*solution.workspace, solution);
+
+      if(nullptr != row_duals && false == presolved) {
+        const c_float* y = solution.workspace->solution->y;
+        for(size_t row = 0; row < constants.num_constraints; ++row) {
+          row_duals[row] = -1 != row_map[row] ? y[row_map[row]] : 0;
+        }
+      }
+
+      // Duals of the equilibrated rows are mapped back onto the rows as
+      // given. The rows of a presolved problem are not the rows as given.
+      if(nullptr != row_scales && false == presolved) {
+        UnscaleDuals(constants.num_constraints, row_scales, row_map, solution.workspace->solution->y);
+      }
+
+      if(nullptr == active_rows) {
+        break;
+      }
 
-    c_float q[constants.total_num_params];
-    for(size_t param_idx = 0; param_idx < constants.total_num_params; ++param_idx) {
-      q[param_idx] = 0;
+      // Add the rows of every violated sample point. Node rows and
+      // continuity rows are always active.
+      Multiply(data->A, variables, row_values);
+      size_t num_violated_rows = 0;
+      for(size_t row = 0; row < constants.num_constraints; ++row) {
+        // The tolerance is in the units of the row as given
+        const double tolerance 
+          = this->options_.lazy_tolerance * (nullptr != row_scales ? row_scales[row] : 1.0);
+        if(0 == active_rows[row] 
+            && (row_values[row] < data->l[row] - tolerance
+              || row_values[row] > data->u[row] + tolerance)) {
+          active_rows[row] = 1;
+          num_violated_rows++;
+        }
+      }
+      if(0 == num_violated_rows) {
+        break;
+      }
     }
 
-    c_float l[constants.num_constraints], u[constants.num_constraints];
-    for(size_t row_idx = 0; row_idx < constants.num_constraints; ++row_idx) {
-      l[row_idx] = lower_bound_vec(row_idx, 0);
-      u[row_idx] = upper_bound_vec(row_idx, 0);
+    // Map the solution back to the monomial polynomial coefficients
+    solution.x = MonomialCoefficients(
+        constants, basis, assembly.node_derivative_map.get(), false == presolved, variables, num_variables);
+
+    // The workspace only holds the duals of the rows handed to the final
+    // solve
+    if(nullptr != row_map && false == presolved) {
+      const c_float* y = solution.workspace->solution->y;
+      std::shared_ptr<std::vector<double>> row_y 
+        = std::make_shared<std::vector<double>>(constants.num_constraints, 0);
+      for(size_t row = 0; row < constants.num_constraints; ++row) {
+        if(-1 != row_map[row]) {
+          (*row_y)[row] = y[row_map[row]];
+        }
+      }
+      solution.y = row_y;
     }
 
-    /*
-     * RUN THE SOLVER
-     */
-    // Allocate and populate data
-    std::shared_ptr<OSQPData> data = std::shared_ptr<OSQPData>(
-        (OSQPData *)c_malloc(sizeof(OSQPData)),
-        [](OSQPData* data) {
-          c_free(data->A);
-          c_free(data->P);
-        });
-    data->n = constants.total_num_params;
-    data->m = constants.num_constraints;
-    data->P = P;
-    data->q = q;
-    data->A = A;
-    data->l = l;
-    data->u = u;
-
-    // Allocate and prepare workspace
-    // Workspace shared pointer requires custom destructor
-    PolynomialSolver::Solution solution;
-    solution.num_dimensions   = constants.num_dimensions;
-    solution.polynomial_order = constants.polynomial_order;
-    solution.num_nodes        = constants.num_nodes;
-    solution.workspace =  std::shared_ptr<OSQPWorkspace>(
-        osqp_setup(data.get(), &this->options_.osqp_settings),
-        [](OSQPWorkspace* workspace) { 
-          osqp_cleanup(workspace);
-        });
-
-    // Solve
-    osqp_solve(solution.workspace.get());
+    // OSQP holds its own copy of the problem. Under a memory budget, the
+    // arenas are not kept for the next run.
+    if(0 != this->options_.memory_budget) {
+      this->arena_.Release();
+      this->scratch_arena_.Release();
+    }
 
     // Return the solution
     return solution;
   }
 
+  void PolynomialSolver::SetWorkspaceCacheCapacity(const size_t capacity) {
+    WorkspaceCache::Instance()->SetCapacity(capacity);
+  }
+
+  struct PolynomialSolver::Problem::State {
+    State(
+        const Options& options_,
+        const std::vector<double>& times_,
+        const std::vector<NodeEqualityBound>& node_equality_bounds_,
+        const std::vector<NodeInequalityBound>& node_inequality_bounds_,
+        const std::vector<SegmentInequalityBound>& segment_inequality_bounds_,
+        const std::vector<SegmentBoxBound>& segment_box_bounds_,
+        const std::vector<SegmentPolytopeBound>& segment_polytope_bounds_,
+        const std::vector<NodeRangeBound>& node_range_bounds_,
+        const std::vector<NodeValuesBound>& node_values_bounds_,
+        const std::vector<SegmentRangeBound>& segment_range_bounds_)
+      : options(options_),
+        times(times_),
+        node_equality_bounds(node_equality_bounds_),
+        node_inequality_bounds(node_inequality_bounds_),
+        segment_inequality_bounds(segment_inequality_bounds_),
+        segment_box_bounds(segment_box_bounds_),
+        segment_polytope_bounds(segment_polytope_bounds_),
+        node_range_bounds(node_range_bounds_),
+        node_values_bounds(node_values_bounds_),
+        segment_range_bounds(segment_range_bounds_),
+        segment_bound_views(segment_inequality_bounds_.size()),
+        basis(options_.basis, options_.polynomial_order) {
+      ViewSegmentBounds(this->options, this->segment_inequality_bounds, this->segment_bound_views.data());
+    }
+
+    ProblemBounds Bounds() const {
+      const ProblemBounds bounds = {
+        this->node_equality_bounds, 
+        this->node_inequality_bounds, 
+        this->segment_bound_views.data(), 
+        this->segment_bound_views.size(),
+        this->segment_box_bounds,
+        this->segment_polytope_bounds,
+        this->node_range_bounds,
+        this->node_values_bounds,
+        this->segment_range_bounds
+      };
+      return bounds;
+    }
+
+    // Regenerates the bound vectors after the bounds were replaced
+    void UpdateBounds() {
+      ViewSegmentBounds(this->options, this->segment_inequality_bounds, this->segment_bound_views.data());
+      this->scratch_arena.Reset();
+      AssembleBounds(
+          this->constants,
+          this->basis,
+          this->times,
+          this->Bounds(),
+          this->assembly.data->l,
+          this->assembly.data->u,
+          this->assembly.row_scales,
+          this->thread_pool.get(),
+          this->scratch_arena);
+      this->bounds_changed = true;
+      this->values_checked = false;
+    }
+
+    Options options;
+    std::vector<double> times;
+
+    // Copies of the bounds. Replaced, never modified, by updates.
+    std::vector<NodeEqualityBound> node_equality_bounds;
+    std::vector<NodeInequalityBound> node_inequality_bounds;
+    std::vector<SegmentInequalityBound> segment_inequality_bounds;
+    std::vector<SegmentBoxBound> segment_box_bounds;
+    std::vector<SegmentPolytopeBound> segment_polytope_bounds;
+    std::vector<NodeRangeBound> node_range_bounds;
+    std::vector<NodeValuesBound> node_values_bounds;
+    std::vector<SegmentRangeBound> segment_range_bounds;
+    std::vector<SegmentBoundView> segment_bound_views;
+
+    Constants constants;
+    const PolynomialBasis basis;
+    // The assembly lives in arenas[arena_idx]. A time update assembles into
+    // the other arena, so the current assembly stays valid until it is
+    // replaced.
+    Arena arenas[2];
+    size_t arena_idx = 0;
+    Arena scratch_arena;
+    std::shared_ptr<ThreadPool> thread_pool;
+    Assembly assembly;
+    size_t predicted_peak_memory = 0;
+
+    // Null until the first solve
+    std::shared_ptr<OSQPWorkspace> workspace;
+    // Whether the bound vectors and the matrices changed since they were
+    // handed to OSQP
+    bool bounds_changed = false;
+    bool matrices_changed = false;
+    // Whether the bounds as set up passed the bound pre-check, and whether
+    // the current times and bound values passed the value check
+    bool bounds_checked = false;
+    bool values_checked = false;
+
+    // Primal and dual solution of the previous solve, as returned by OSQP.
+    // Empty until the first solve.
+    std::vector<c_float> previous_x;
+    std::vector<c_float> previous_y;
+  };
+
+  PolynomialSolver::Problem PolynomialSolver::Setup(
+      const std::vector<double>& times,
+      const std::vector<NodeEqualityBound>& node_equality_bounds,
+      const std::vector<NodeInequalityBound>& node_inequality_bounds,
+      const std::vector<SegmentInequalityBound>& segment_inequality_bounds,
+      const std::vector<SegmentBoxBound>& segment_box_bounds,
+      const std::vector<SegmentPolytopeBound>& segment_polytope_bounds,
+      const std::vector<NodeRangeBound>& node_range_bounds,
+      const std::vector<NodeValuesBound>& node_values_bounds,
+      const std::vector<SegmentRangeBound>& segment_range_bounds) {
+    this->options_.Check();
+    if(true == this->options_.presolve || true == this->options_.lazy_segment_bounds) {
+      std::cerr << "PolynomialSolver::Setup -- Persistent problems support neither presolve nor lazy segment bounds." << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    Problem problem;
+    problem.state_ = std::make_shared<Problem::State>(
+        this->options_,
+        times,
+        node_equality_bounds,
+        node_inequality_bounds,
+        segment_inequality_bounds,
+        segment_box_bounds,
+        segment_polytope_bounds,
+        node_range_bounds,
+        node_values_bounds,
+        segment_range_bounds);
+    Problem::State& state = *problem.state_;
+
+    const ProblemBounds bounds = state.Bounds();
+    state.constants = MakeConstants(state.options, state.times, bounds);
+    AcquireThreadPool(state.options.num_threads, this->thread_pool_);
+    state.thread_pool = this->thread_pool_;
+    Assemble(
+        state.options,
+        state.constants,
+        state.basis,
+        state.times,
+        bounds,
+        state.thread_pool.get(),
+        true,
+        state.arenas[state.arena_idx],
+        state.scratch_arena,
+        state.assembly);
+
+    return problem;
+  }
+
+  PolynomialSolver::Solution PolynomialSolver::Problem::Solve() {
+    State& state = *this->state_;
+    const Constants& constants = state.constants;
+    OSQPData* data = state.assembly.data;
+
+    PolynomialSolver::Solution solution = MakeSolution(constants);
+    // The problem as set up gets the full pre-check. Updates only change
+    // values, so the times and bound values are checked after every update.
+    if(true == state.options.check_bounds 
+        && (false == state.bounds_checked || false == state.values_checked)) {
+      if(false == state.bounds_checked) {
+        solution.diagnostic = this->CheckBounds();
+      } else {
+        solution.diagnostic = CheckBoundValues(constants, state.times, state.Bounds());
+      }
+      if(false == solution.diagnostic.Ok()) {
+        solution.status = SolveStatus::BOUND_CONFLICT;
+        return solution;
+      }
+      state.bounds_checked = true;
+      state.values_checked = true;
+    }
+
+    if(nullptr == state.workspace) {
+      if(0 != state.options.memory_budget) {
+        state.scratch_arena.Release();
+      }
+      state.predicted_peak_memory 
+        = PredictRunMemory(state.options, *data, state.arenas[state.arena_idx], state.scratch_arena)
+        + state.arenas[1 - state.arena_idx].Capacity();
+      if(true == ExceedsBudget(state.options, state.predicted_peak_memory)) {
+        solution.status = SolveStatus::MEMORY_BUDGET_EXCEEDED;
+        solution.predicted_peak_memory = state.predicted_peak_memory;
+        return solution;
+      }
+      state.workspace = std::shared_ptr<OSQPWorkspace>(
+          osqp_setup(data, &state.options.osqp_settings),
+          [](OSQPWorkspace* workspace) { 
+            osqp_cleanup(workspace);
+          });
+    } else {
+      // OSQP rejects some values, e.g. a lower bound above the upper bound,
+      // and keeps its previous values. The changes are handed over again on
+      // the next solve.
+      c_int update_status = 0;
+      if(true == state.matrices_changed) {
+        const csc* A = data->A;
+        // The cost of the coefficient formulation does not depend on the
+        // times
+        if(nullptr == state.assembly.node_derivative_map) {
+          update_status = osqp_update_A(state.workspace.get(), A->x, nullptr, A->p[A->n]);
+        } else {
+          const csc* P = data->P;
+          update_status = osqp_update_P_A(
+              state.workspace.get(), P->x, nullptr, P->p[P->n], A->x, nullptr, A->p[A->n]);
+        }
+      }
+      if(0 == update_status && true == state.bounds_changed) {
+        update_status = osqp_update_bounds(state.workspace.get(), data->l, data->u);
+      }
+      if(0 != update_status) {
+        solution.status = SolveStatus::UPDATE_REJECTED;
+        solution.osqp_status = update_status;
+        return solution;
+      }
+    }
+    state.bounds_changed = false;
+    state.matrices_changed = false;
+
+    OSQPWorkspace* workspace = state.workspace.get();
+    if(false == state.previous_x.empty()) {
+      osqp_warm_start(workspace, state.previous_x.data(), state.previous_y.data());
+    }
+
+    osqp_solve(workspace);
+    RecordSolve(*workspace, solution);
+
+    // Kept before the duals are unscaled, in the units of the problem
+    // handed to OSQP
+    state.previous_x.assign(workspace->solution->x, workspace->solution->x + data->n);
+    state.previous_y.assign(workspace->solution->y, workspace->solution->y + data->m);
+    if(nullptr != state.assembly.row_scales) {
+      UnscaleDuals(constants.num_constraints, state.assembly.row_scales, nullptr, workspace->solution->y);
+    }
+
+    solution.workspace = state.workspace;
+    solution.predicted_peak_memory = state.predicted_peak_memory;
+    solution.x = MonomialCoefficients(
+        constants, state.basis, state.assembly.node_derivative_map.get(), true, workspace->solution->x, data->n);
+    return solution;
+  }
+
+  BoundDiagnostic PolynomialSolver::Problem::CheckBounds() const {
+    State& state = *this->state_;
+    state.scratch_arena.Reset();
+    return p4::CheckBounds(state.constants, state.times, state.Bounds(), state.scratch_arena);
+  }
+
+  void PolynomialSolver::Problem::UpdateTimes(const std::vector<double>& times) {
+    State& state = *this->state_;
+    if(times.size() != state.constants.num_nodes) {
+      std::cerr << "PolynomialSolver::Problem::UpdateTimes -- Time vector must have an entry for every node of the problem." << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    state.times = times;
+
+    // Times only change values, unless an entry happens to vanish. The
+    // values are rewritten in place and handed to OSQP on the next solve,
+    // so OSQP keeps its symbolic factorization and memory.
+    state.scratch_arena.Reset();
+    if(true == RewriteTimes(
+          state.constants,
+          state.basis,
+          state.times,
+          state.Bounds(),
+          state.thread_pool.get(),
+          state.scratch_arena,
+          state.assembly)) {
+      state.bounds_changed = true;
+      state.matrices_changed = true;
+      state.values_checked = false;
+      return;
+    }
+
+    // Otherwise the problem is assembled again and OSQP is set up again on
+    // the next solve
+    Arena& arena = state.arenas[1 - state.arena_idx];
+    arena.Reset();
+    state.scratch_arena.Reset();
+    Assembly assembly;
+    Assemble(
+        state.options,
+        state.constants,
+        state.basis,
+        state.times,
+        state.Bounds(),
+        state.thread_pool.get(),
+        true,
+        arena,
+        state.scratch_arena,
+        assembly);
+    state.workspace.reset();
+
+    state.assembly = std::move(assembly);
+    state.arena_idx = 1 - state.arena_idx;
+    state.bounds_changed = false;
+    state.matrices_changed = false;
+    state.values_checked = false;
+  }
+
+  void PolynomialSolver::Problem::UpdateNodeBounds(
+      const std::vector<NodeEqualityBound>& node_equality_bounds,
+      const std::vector<NodeInequalityBound>& node_inequality_bounds,
+      const std::vector<NodeRangeBound>& node_range_bounds,
+      const std::vector<NodeValuesBound>& node_values_bounds) {
+    State& state = *this->state_;
+    if(false == SameStructure(state.node_equality_bounds, node_equality_bounds)
+        || false == SameStructure(state.node_inequality_bounds, node_inequality_bounds)
+        || false == SameStructure(state.node_range_bounds, node_range_bounds)
+        || false == SameStructure(state.node_values_bounds, node_values_bounds)) {
+      std::cerr << "PolynomialSolver::Problem::UpdateNodeBounds -- Node bounds must have the structure of the node bounds the problem was set up with." << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    // Bounds are not assignable
+    std::vector<NodeEqualityBound>(node_equality_bounds).swap(state.node_equality_bounds);
+    std::vector<NodeInequalityBound>(node_inequality_bounds).swap(state.node_inequality_bounds);
+    std::vector<NodeRangeBound>(node_range_bounds).swap(state.node_range_bounds);
+    std::vector<NodeValuesBound>(node_values_bounds).swap(state.node_values_bounds);
+    state.UpdateBounds();
+  }
+
+  void PolynomialSolver::Problem::UpdateSegmentBoundValues(
+      const std::vector<SegmentInequalityBound>& segment_inequality_bounds,
+      const std::vector<SegmentBoxBound>& segment_box_bounds,
+      const std::vector<SegmentPolytopeBound>& segment_polytope_bounds,
+      const std::vector<SegmentRangeBound>& segment_range_bounds) {
+    State& state = *this->state_;
+    if(false == SameStructure(state.segment_inequality_bounds, segment_inequality_bounds)
+        || false == SameStructure(state.segment_box_bounds, segment_box_bounds)
+        || false == SameStructure(state.segment_polytope_bounds, segment_polytope_bounds)
+        || false == SameStructure(state.segment_range_bounds, segment_range_bounds)) {
+      std::cerr << "PolynomialSolver::Problem::UpdateSegmentBoundValues -- Segment bounds must have the structure of the segment bounds the problem was set up with." << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    std::vector<SegmentInequalityBound>(segment_inequality_bounds).swap(state.segment_inequality_bounds);
+    std::vector<SegmentBoxBound>(segment_box_bounds).swap(state.segment_box_bounds);
+    std::vector<SegmentPolytopeBound>(segment_polytope_bounds).swap(state.segment_polytope_bounds);
+    std::vector<SegmentRangeBound>(segment_range_bounds).swap(state.segment_range_bounds);
+    state.UpdateBounds();
+  }
+
   void PolynomialSolver::Options::Check() {
     if(this->num_dimensions < 1) {
       std::cerr << "PolynomialSolver::Options::Check -- Number of dimensions must be greater than zero." << std::endl;
       std::exit(EXIT_FAILURE);
     }
+
+    if(Formulation::NODE_DERIVATIVES == this->formulation 
+        && this->polynomial_order + 1 < 2 * (this->continuity_order + 1)) {
+      std::cerr << "PolynomialSolver::Options::Check -- The node derivative formulation requires polynomial_order + 1 >= 2 * (continuity_order + 1)." << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    if(true == this->lazy_segment_bounds && this->max_lazy_iterations < 1) {
+      std::cerr << "PolynomialSolver::Options::Check -- Maximum number of lazy iterations must be greater than zero." << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    if(true == this->decouple_dimensions && 0 != this->memory_budget) {
+      std::cerr << "PolynomialSolver::Options::Check -- Decoupled dimensions do not support a memory budget." << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    if(true == this->cache_workspaces 
+        && (true == this->presolve || true == this->lazy_segment_bounds)) {
+      std::cerr << "PolynomialSolver::Options::Check -- Workspace caching supports neither presolve nor lazy segment bounds." << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    if(this->polynomial_order > kMaxPolynomialOrder) {
+      std::cerr << "PolynomialSolver::Options::Check -- Polynomial order must not exceed " << kMaxPolynomialOrder << "." << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    for(const size_t order: this->segment_polynomial_orders) {
+      if(order > this->polynomial_order) {
+        std::cerr << "PolynomialSolver::Options::Check -- Segment polynomial orders must not exceed polynomial_order." << std::endl;
+        std::exit(EXIT_FAILURE);
+      }
+    }
+
+    if(false == this->dimension_polynomial_orders.empty()
+        && this->dimension_polynomial_orders.size() != this->num_dimensions) {
+      std::cerr << "PolynomialSolver::Options::Check -- Dimension polynomial orders must have an entry for every dimension." << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    for(const size_t order: this->dimension_polynomial_orders) {
+      if(order > this->polynomial_order) {
+        std::cerr << "PolynomialSolver::Options::Check -- Dimension polynomial orders must not exceed polynomial_order." << std::endl;
+        std::exit(EXIT_FAILURE);
+      }
+    }
+
+    if(Formulation::NODE_DERIVATIVES == this->formulation 
+        && (false == this->segment_polynomial_orders.empty() || false == this->dimension_polynomial_orders.empty())) {
+      std::cerr << "PolynomialSolver::Options::Check -- The node derivative formulation requires a single polynomial order." << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
   }
 
-  std::vector<std::vector<Eigen::VectorXd>> PolynomialSolver::Solution::Coefficients() const {
-    const size_t num_segments                   = this->num_nodes - 1;
-    const size_t num_params_per_node_per_dim    = this->polynomial_order + 1;
-    const size_t num_params_per_segment_per_dim = this->polynomial_order + 1;
-    const size_t num_params_per_node            = this->num_dimensions * num_params_per_node_per_dim;
-    const size_t num_params_per_segment         = this->num_dimensions * num_params_per_segment_per_dim;
-    const size_t total_num_params               = this->num_nodes * num_params_per_node;
+  double PolynomialSolver::Solution::Coefficient(
+      const size_t dimension_idx, 
+      const size_t node_idx,
+      const size_t coefficient_idx) const {
+    // Coefficients beyond the order of the polynomial are zero
+    if(coefficient_idx >= this->layout.NumCoefficients(dimension_idx, node_idx)) {
+      return 0;
+    }
+    const double* x = nullptr != this->x ? this->x->data() : this->workspace->solution->x;
+    return x[this->layout.Index(dimension_idx, node_idx, coefficient_idx)];
+  }
 
+  std::vector<std::vector<Eigen::VectorXd>> PolynomialSolver::Solution::Coefficients() const {
     std::vector<std::vector<Eigen::VectorXd>> coefficients;
 
     coefficients.resize(this->num_dimensions);
     for(size_t dimension_idx = 0; dimension_idx < this->num_dimensions; ++dimension_idx) {
-      coefficients[dimension_idx].resize(this->num_nodes);
-      for(size_t node_idx = 0; node_idx < this->num_nodes; ++node_idx) {
-        coefficients[dimension_idx][node_idx].resize(num_params_per_node_per_dim);
-        for(size_t coefficient_idx = 0; coefficient_idx < num_params_per_node_per_dim; ++coefficient_idx) {
-          const size_t parameter_idx = 0
-            // Get to the right dimension
-            + num_params_per_node_per_dim * this->num_nodes * dimension_idx
-            // Get to the right node
-            + num_params_per_node_per_dim * node_idx
-            // Get to the right parameter idx
-            + coefficient_idx;
-
-          coefficients[dimension_idx][node_idx](coefficient_idx)
-            = this->workspace->solution->x[parameter_idx];
-        }
+      coefficients[dimension_idx].resize(this->num_nodes - 1);
+      for(size_t node_idx = 0; node_idx + 1 < this->num_nodes; ++node_idx) {
+        coefficients[dimension_idx][node_idx] = this->Coefficients(dimension_idx, node_idx);
       }
     }
     return coefficients;
@@ -517,29 +3987,15 @@ namespace p4 {
   Eigen::VectorXd PolynomialSolver::Solution::Coefficients(
       const size_t dimension_idx, 
       const size_t node_idx) const {
-    const size_t num_segments                   = this->num_nodes - 1;
-    const size_t num_params_per_node_per_dim    = this->polynomial_order + 1;
-    const size_t num_params_per_segment_per_dim = this->polynomial_order + 1;
-    const size_t num_params_per_node            = this->num_dimensions * num_params_per_node_per_dim;
-    const size_t num_params_per_segment         = this->num_dimensions * num_params_per_segment_per_dim;
-    const size_t total_num_params               = this->num_nodes * num_params_per_node;
+    const size_t num_params_per_node_per_dim = this->layout.NumCoefficients(dimension_idx, node_idx);
 
     Eigen::VectorXd coefficients;
     coefficients.resize(num_params_per_node_per_dim);
     for(size_t coefficient_idx = 0; coefficient_idx < num_params_per_node_per_dim; ++coefficient_idx) {
-      const size_t parameter_idx = 0
-        // Get to the right dimension
-        + num_params_per_node_per_dim * this->num_nodes * dimension_idx
-        // Get to the right node
-        + num_params_per_node_per_dim * node_idx
-        // Get to the right parameter idx
-        + coefficient_idx;
-
-      coefficients(coefficient_idx)
-        = this->workspace->solution->x[parameter_idx];
+      coefficients(coefficient_idx) 
+        = this->Coefficient(dimension_idx, node_idx, coefficient_idx);
     }
 
     return coefficients;
   }
 }
-
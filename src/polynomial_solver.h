@@ -6,8 +6,86 @@
 #include <memory>
 
 #include "polynomial_bounds.h"
+#include "arena.h"
+#include "variable_layout.h"
+#include "polynomial_basis.h"
 
 namespace p4 {
+  // The assembler's view of a segment inequality bound. Decouples assembly
+  // from how the mapping is stored so that the runtime-sized and fixed-size
+  // front ends share a single assembler.
+  struct SegmentBoundView {
+    size_t segment_idx;
+    size_t derivative_idx;
+    // Points to mapping_size mapping coefficients. Bounds with fewer than
+    // num_dimensions coefficients are outside of the problem.
+    const double* mapping;
+    size_t mapping_size;
+    double value;
+  };
+
+  // Every bound of a problem as seen by the assembler. References the bounds
+  // of the caller; nothing is copied.
+  struct ProblemBounds {
+    const std::vector<NodeEqualityBound>& node_equality_bounds;
+    const std::vector<NodeInequalityBound>& node_inequality_bounds;
+    const SegmentBoundView* segment_inequality_bounds;
+    size_t num_segment_inequality_bounds;
+    const std::vector<SegmentBoxBound>& segment_box_bounds;
+    const std::vector<SegmentPolytopeBound>& segment_polytope_bounds;
+    const std::vector<NodeRangeBound>& node_range_bounds;
+    const std::vector<NodeValuesBound>& node_values_bounds;
+    const std::vector<SegmentRangeBound>& segment_range_bounds;
+  };
+
+  // Decision variables of the QP
+  enum class Formulation {
+    // The polynomial coefficients of every segment, tied together by
+    // continuity constraints
+    COEFFICIENTS,
+    // The derivatives up to continuity_order at every node, plus the
+    // coefficients of every segment not fixed by them. Continuity holds by
+    // construction. See NodeDerivativeMap.
+    NODE_DERIVATIVES
+  };
+
+  // Points at which segment bounds are enforced
+  enum class SegmentBoundPoints {
+    // num_intermediate_points + 2 evenly spaced samples, including the
+    // endpoints of the segment. Bounds may be violated between samples.
+    SAMPLES,
+    // Bernstein control points of the bounded derivative, a linear map of
+    // the coefficients. By the convex hull property, bounds hold over the
+    // whole segment. polynomial_order - derivative_idx + 1 points per bound.
+    // Conservative: a trajectory that meets a bound may still need its
+    // control points to be pulled inside it.
+    BERNSTEIN
+  };
+
+  // Outcome of a run, however the problem was solved
+  enum class SolveStatus {
+    // The problem was not handed to a solver
+    NOT_SOLVED,
+    // Solved within the tolerances of the OSQP settings
+    SOLVED,
+    // Solved within the tolerances of OSQP's inaccurate termination
+    SOLVED_INACCURATE,
+    // OSQP stopped without a solution, e.g. on the iteration limit or an
+    // infeasible problem. See Solution::osqp_status.
+    UNSOLVED,
+    // The bound pre-check found a conflict. See Solution::diagnostic.
+    BOUND_CONFLICT,
+    // The predicted peak memory exceeds the memory budget. See
+    // Solution::predicted_peak_memory.
+    MEMORY_BUDGET_EXCEEDED,
+    // OSQP rejected the values of an updated problem and kept the previous
+    // ones. See Solution::osqp_status and PolynomialSolver::Problem.
+    UPDATE_REJECTED
+  };
+
+  template <size_t Order, size_t Dims> class PolynomialSolverT;
+  class ThreadPool;
+
   /* Class for solving piecewise polynomial fitting & minimization problems.
    *
    * Given a polynomial of the following form:
@@ -32,9 +110,12 @@ namespace p4 {
    * Notes: 
    * 1) polynomial_order must be 3 or more orders greater than derivative_order
    * 2) continuity_order must be less than polynomial_order.
-   * 3) state vector is ordered first by polynomial index, then by segment index,
-   *    and finally by dimension index.
-   * 4) see theory documention for further information
+   * 3) by default, the state vector is ordered first by polynomial index, then
+   *    by segment index, and finally by dimension index. See
+   *    Options::variable_ordering.
+   * 4) there is one polynomial per segment. Bounds on the final node are
+   *    applied at the end of the final segment.
+   * 5) see theory documention for further information
    */
   class PolynomialSolver {
     public:
@@ -46,9 +127,139 @@ namespace p4 {
         size_t derivative_order = 0;
         size_t continuity_order = 0;
 
+        // Optional per-segment and per-dimension polynomial orders. The
+        // polynomial of a dimension and segment has the lower of its segment
+        // order and its dimension order, and polynomial_order where neither
+        // is given. Empty, or one entry per segment and per dimension
+        // respectively; no entry may exceed polynomial_order. Not supported
+        // by the node derivative formulation.
+        std::vector<size_t> segment_polynomial_orders;
+        std::vector<size_t> dimension_polynomial_orders;
+
         // Number of intermediate points for segment inequality constraints
         size_t num_intermediate_points = 20;
 
+        // Points at which every segment bound is enforced. With BERNSTEIN,
+        // num_intermediate_points is unused.
+        SegmentBoundPoints segment_bound_points = SegmentBoundPoints::SAMPLES;
+
+        // Number of threads used to assemble the problem and to solve the
+        // groups of a decoupled problem. 0 uses the hardware concurrency,
+        // and at most one thread per group. The assembled problem does not
+        // depend on the number of threads.
+        size_t num_threads = 1;
+
+        // Order of the coefficients in the QP state vector. SEGMENT_MAJOR
+        // keeps the coefficients of every dimension of a segment together.
+        VariableOrdering variable_ordering = VariableOrdering::DIMENSION_MAJOR;
+
+        // Reduce the problem before handing it to OSQP: fold node bounds
+        // into variable intervals, substitute out fixed coefficients and
+        // drop redundant rows. See Presolver.
+        bool presolve = false;
+
+        // Decision variables of the QP. NODE_DERIVATIVES requires
+        // polynomial_order + 1 >= 2 * (continuity_order + 1).
+        Formulation formulation = Formulation::COEFFICIENTS;
+
+        // Generate segment bound rows lazily. The problem is first solved
+        // with only the rows at the endpoints of every segment bound. The
+        // solution is then checked at every sample point, the rows of
+        // violated sample points are added and the problem is re-solved,
+        // warm-started from the previous solution. Stops once every segment
+        // bound holds within lazy_tolerance. The final permitted solve
+        // includes every row, so the result never violates a bound that the
+        // eager problem would enforce. Each solve is set up anew with the
+        // rows active by then; its buffers are reused from one solve to the
+        // next, and it starts from the primal solution and the duals of the
+        // rows that stay active. See Solution::y for the duals of every row.
+        bool lazy_segment_bounds = false;
+        // Violation tolerance of a segment bound row, in the units of the
+        // constraint row
+        double lazy_tolerance = 1e-3;
+        // Maximum number of solves
+        size_t max_lazy_iterations = 10;
+
+        // Basis of the segment polynomials in the QP. The orthogonal bases
+        // condition the cost better, which typically cuts OSQP iterations at
+        // higher polynomial orders. Solutions are always reported as monomial
+        // coefficients.
+        Basis basis = Basis::MONOMIAL;
+
+        // Peak memory, in bytes, a run may use. Before OSQP allocates its
+        // workspace, the run releases its assembly buffers and predicts its
+        // peak footprint; if the prediction exceeds the budget, the run
+        // returns the prediction with the status MEMORY_BUDGET_EXCEEDED
+        // instead of setting up OSQP, and the workspace is null. Buffers
+        // are not kept between runs. 0 disables the budget. See
+        // PredictPeakMemory.
+        size_t memory_budget = 0;
+
+        // Whether to pre-check the bounds before the problem is assembled.
+        // The check is linear in the number of bounds and catches
+        // non-increasing times, explicit bounds outside of the problem,
+        // contradicting node bounds, node bounds that exclude zero on a
+        // derivative above the order of a segment, segment bounds with a
+        // lower value above the upper value and node bounds that violate a
+        // segment bound at the endpoint of the segment. On a conflict, the
+        // run returns the diagnostic with the status BOUND_CONFLICT,
+        // without calling OSQP, and the workspace is null. Passing the
+        // check does not imply feasibility.
+        bool check_bounds = true;
+
+        // Whether to equilibrate the constraint rows before OSQP setup. Node
+        // and segment bound rows are time vectors, while continuity rows
+        // carry inverse powers of the segment durations, so row magnitudes
+        // spread with the durations. Every row is scaled so that its largest
+        // entry is one, using scales that follow from the structure of the
+        // row. Only rows are scaled, so the primal solution is unchanged;
+        // the duals in the workspace are mapped back onto the rows as given
+        // unless the problem was presolved. The constraint data held by the
+        // workspace is the equilibrated problem.
+        bool equilibrate_rows = false;
+
+        // Whether to take the OSQP workspace from a process-wide cache of
+        // workspaces shared by every solver. Workspaces are keyed on a
+        // fingerprint of the structure of the problem: the options, the
+        // number of nodes and the indices, mappings and faces of the
+        // bounds. A run whose problem has the sparsity pattern and OSQP
+        // settings of an idle cached workspace hands its values to that
+        // workspace instead of setting up OSQP, which skips the KKT ordering
+        // and symbolic factorization. The workspace returns to the cache
+        // once every copy of the solution has been released. Not supported
+        // with presolve or lazy segment bounds. Problems keep their own
+        // workspace. See SetWorkspaceCacheCapacity.
+        bool cache_workspaces = false;
+
+        // Whether to split the problem into independent groups of
+        // dimensions. The cost and every bound other than segment inequality
+        // and polytope bounds touch a single dimension, so dimensions are
+        // only coupled through the nonzero entries of mappings and faces.
+        // With more than one group, every group is solved as a smaller
+        // problem of its own, concurrently over num_threads threads, and
+        // the coefficients are stitched into a single solution. The
+        // workspace of the solution is then null; Solution::status
+        // summarizes the groups, whose workspaces are in
+        // Solution::component_workspaces. Off by default because the duals
+        // and OSQP information are then split over several workspaces,
+        // which callers that read the workspace must opt in to. Off means
+        // the problem is solved as one QP, as is every problem set up with
+        // Setup. Not supported with a memory budget.
+        bool decouple_dimensions = false;
+
+        // Whether to solve problems whose every row is an equality, e.g.
+        // waypoints and continuity only, without OSQP. The optimum then
+        // solves a single linear KKT system, which is banded along the
+        // chain of segments and is factorized directly in time linear in
+        // the number of nodes. See DirectSolver. The direct solve is chosen
+        // automatically; problems with inequalities, singular KKT systems
+        // and solutions that miss the OSQP tolerances go to OSQP. A problem
+        // solved directly has no workspace; see Solution::status,
+        // Solution::solved_directly and Solution::y. Disable to always hand
+        // problems to OSQP, e.g. to time it.
+        // Not used under a memory budget.
+        bool direct_equality_solve = true;
+
         // Solver settings. These are freed after
         OSQPSettings osqp_settings;
   
@@ -68,15 +279,81 @@ namespace p4 {
         //   a) workspace.info.obj_val: the optimal cost of the optimization
         //   problem: J = 0.5 * x' * P * x
         //   b) workspace.solution: solution and lagrange multipliers
+        // With lazy segment bounds, the workspace holds the final solve, whose
+        // constraints only include the segment bound rows added by then.
+        // Null when the problem was not handed to OSQP or was split into
+        // several problems; status, objective and iterations summarize every
+        // run.
         // Resources: 
         //   a) https://osqp.org/docs/interfaces/cc++#workspace
         std::shared_ptr<OSQPWorkspace> workspace = nullptr;
 
+        // Outcome of the run, set however the problem was solved. A
+        // decoupled problem reports the worst status of its groups.
+        SolveStatus status = SolveStatus::NOT_SOLVED;
+
+        // OSQP status value of the final solve, e.g. OSQP_SOLVED, or of the
+        // group that set the status of a decoupled problem. The error code
+        // of the update with UPDATE_REJECTED. 0 if OSQP was not run.
+        c_int osqp_status = 0;
+
+        // Optimal cost J = 0.5 * x' * P * x of the problem as given,
+        // including the cost of presolved variables and summed over the
+        // groups of a decoupled problem. Meaningless unless solved.
+        double objective = 0;
+
+        // Number of OSQP iterations, summed over lazy solves and groups. 0
+        // for a direct solve.
+        size_t iterations = 0;
+
         // Required
         size_t num_dimensions   = 0;
+        // Highest polynomial order. See layout for the order of every
+        // polynomial.
         size_t polynomial_order = 0;
         size_t num_nodes        = 0;
 
+        // Maps coefficients to the OSQP state vector and holds the number of
+        // coefficients of every polynomial
+        VariableLayout layout;
+
+        // Predicted peak memory of the run in bytes: the assembled problem
+        // plus the predicted OSQP workspace. See Options::memory_budget.
+        size_t predicted_peak_memory = 0;
+
+        // Conflict found by the bound pre-check. See Options::check_bounds.
+        BoundDiagnostic diagnostic;
+
+        // Workspace of every group of dimensions solved on its own, and the
+        // dimensions of every group in increasing order. Dimensions are
+        // renumbered within their group. The optimal cost is the sum over
+        // the workspaces. A group solved directly has a null workspace.
+        // Empty unless the problem was decoupled; see
+        // Options::decouple_dimensions.
+        std::vector<std::shared_ptr<OSQPWorkspace>> component_workspaces;
+        std::vector<std::vector<size_t>> component_dimensions;
+
+        // Whether the problem, or every group of a decoupled problem, was
+        // solved by the direct KKT solve. The workspace is then null and x
+        // holds the coefficients. See Options::direct_equality_solve.
+        bool solved_directly = false;
+
+        // Full monomial coefficient vector when the problem solved by OSQP is
+        // not the monomial coefficient QP, i.e. when it was presolved or
+        // decoupled, or uses the node derivative formulation or another
+        // basis, and when it was solved directly. The workspace then holds
+        // that problem and its solution, if any. With presolve,
+        // workspace.info.obj_val includes the cost of the fixed variables.
+        // Null otherwise.
+        std::shared_ptr<const std::vector<double>> x = nullptr;
+
+        // Duals of every constraint row as given when segment bounds are
+        // lazy, zero for the rows left out of the final solve, whose
+        // workspace only holds the rows handed to it, and when the problem
+        // was solved directly. Null otherwise, and when the final solve was
+        // presolved.
+        std::shared_ptr<const std::vector<double>> y = nullptr;
+
         Solution() {};
 
         // Reshapes the coefficients of the OSQP solution into a more usable
@@ -85,22 +362,174 @@ namespace p4 {
         std::vector<std::vector<Eigen::VectorXd>> Coefficients() const;
 
         // Returns an Eigen vector containing the coefficients for a specified
-        // dimension and segment index.
+        // dimension and segment index. Its size is the number of coefficients
+        // of that polynomial.
         Eigen::VectorXd Coefficients(
             const size_t dimension_idx, 
             const size_t node_idx) const;
+
+        // Returns a single coefficient of a specified dimension and segment
+        // index. Coefficients beyond the order of the polynomial are zero.
+        // Does not allocate.
+        double Coefficient(
+            const size_t dimension_idx, 
+            const size_t node_idx,
+            const size_t coefficient_idx) const;
+      };
+
+      /* Problem whose OSQP workspace is kept between solves, for replanning
+       * a problem of fixed shape. Only the values of the bounds may change:
+       * updated bounds must have the structure of the bounds the problem was
+       * set up with, i.e. the same number of bounds of every kind, each on
+       * the same indices, and the same mappings and faces for segment
+       * inequality and polytope bounds. Bound updates rewrite the bound
+       * vectors and hand them to OSQP with osqp_update_bounds, so the KKT
+       * factorization is reused. The times may change as well. Every solve
+       * is warm-started from the primal and dual solution of the previous
+       * one.
+       *
+       * Neither presolve nor lazy segment bounds are supported, since both
+       * change the rows handed to OSQP with the bounds. The buffers of the
+       * problem are kept for its lifetime. Copies share the problem.
+       *
+       * With Options::check_bounds, the bounds are pre-checked on the first
+       * solve. Since updates only change values, the solve after an update
+       * only checks that the times increase and that no two-sided bound has
+       * a lower value above its upper value. Call CheckBounds to run the
+       * full pre-check on updated times and bounds.
+       *
+       * Updates are handed to OSQP on the next solve. If OSQP rejects them,
+       * the solve returns UPDATE_REJECTED without solving, and they are
+       * handed over again on the following solve.
+       */
+      class Problem {
+        public:
+          // Solves the problem. OSQP is set up on the first solve. Every
+          // returned solution shares the workspace of the problem, so it
+          // only holds the latest solve.
+          Solution Solve();
+
+          // Runs the bound pre-check of Options::check_bounds on the current
+          // times and bounds
+          BoundDiagnostic CheckBounds() const;
+
+          // Replaces the times of the nodes. Times change the values of the
+          // problem but not its sparsity pattern, so the values of the
+          // constraint matrix and bounds, and of the cost with the node
+          // derivative formulation, are rewritten in place over the stored
+          // pattern and handed to OSQP on the next solve with osqp_update_A
+          // or osqp_update_P_A, which keep the symbolic factorization and
+          // the memory of the workspace. If the pattern did change, the
+          // problem is assembled again and OSQP is set up again on the next
+          // solve.
+          void UpdateTimes(const std::vector<double>& times);
+
+          // Replaces the node bounds
+          void UpdateNodeBounds(
+              const std::vector<NodeEqualityBound>& node_equality_bounds,
+              const std::vector<NodeInequalityBound>& node_inequality_bounds,
+              const std::vector<NodeRangeBound>& node_range_bounds = std::vector<NodeRangeBound>(),
+              const std::vector<NodeValuesBound>& node_values_bounds = std::vector<NodeValuesBound>());
+
+          // Replaces the segment bounds. Only the values, lower and upper
+          // limits and offsets may differ.
+          void UpdateSegmentBoundValues(
+              const std::vector<SegmentInequalityBound>& segment_inequality_bounds,
+              const std::vector<SegmentBoxBound>& segment_box_bounds = std::vector<SegmentBoxBound>(),
+              const std::vector<SegmentPolytopeBound>& segment_polytope_bounds = std::vector<SegmentPolytopeBound>(),
+              const std::vector<SegmentRangeBound>& segment_range_bounds = std::vector<SegmentRangeBound>());
+
+        private:
+          friend class PolynomialSolver;
+
+          struct State;
+
+          Problem() {}
+
+          std::shared_ptr<State> state_;
       };
 
       PolynomialSolver(const Options& options = Options())
         : options_(options) {}
+
+      // Sets the maximum number of idle workspaces held by the process-wide
+      // workspace cache. Defaults to 16. See Options::cache_workspaces.
+      static void SetWorkspaceCacheCapacity(const size_t capacity);
   
       Solution Run(
           const std::vector<double>& times,
           const std::vector<NodeEqualityBound>& node_equality_bounds,
           const std::vector<NodeInequalityBound>& node_inequality_bounds,
-          const std::vector<SegmentInequalityBound>& segment_inequality_bounds);
+          const std::vector<SegmentInequalityBound>& segment_inequality_bounds,
+          const std::vector<SegmentBoxBound>& segment_box_bounds = std::vector<SegmentBoxBound>(),
+          const std::vector<SegmentPolytopeBound>& segment_polytope_bounds = std::vector<SegmentPolytopeBound>(),
+          const std::vector<NodeRangeBound>& node_range_bounds = std::vector<NodeRangeBound>(),
+          const std::vector<NodeValuesBound>& node_values_bounds = std::vector<NodeValuesBound>(),
+          const std::vector<SegmentRangeBound>& segment_range_bounds = std::vector<SegmentRangeBound>());
+
+      // Predicted peak memory of Run, in bytes, without setting up OSQP.
+      // Assembles and presolves the problem like Run. With lazy segment
+      // bounds, predicts the final solve, which holds every row. A problem
+      // whose dimensions are decoupled predicts the sum over its groups.
+      // 0 if the bound pre-check finds a conflict.
+      size_t PredictPeakMemory(
+          const std::vector<double>& times,
+          const std::vector<NodeEqualityBound>& node_equality_bounds,
+          const std::vector<NodeInequalityBound>& node_inequality_bounds,
+          const std::vector<SegmentInequalityBound>& segment_inequality_bounds,
+          const std::vector<SegmentBoxBound>& segment_box_bounds = std::vector<SegmentBoxBound>(),
+          const std::vector<SegmentPolytopeBound>& segment_polytope_bounds = std::vector<SegmentPolytopeBound>(),
+          const std::vector<NodeRangeBound>& node_range_bounds = std::vector<NodeRangeBound>(),
+          const std::vector<NodeValuesBound>& node_values_bounds = std::vector<NodeValuesBound>(),
+          const std::vector<SegmentRangeBound>& segment_range_bounds = std::vector<SegmentRangeBound>());
+
+      // Assembles a problem for repeated solves with the options of the
+      // solver. Takes the same bounds as Run. See Problem.
+      Problem Setup(
+          const std::vector<double>& times,
+          const std::vector<NodeEqualityBound>& node_equality_bounds,
+          const std::vector<NodeInequalityBound>& node_inequality_bounds,
+          const std::vector<SegmentInequalityBound>& segment_inequality_bounds,
+          const std::vector<SegmentBoxBound>& segment_box_bounds = std::vector<SegmentBoxBound>(),
+          const std::vector<SegmentPolytopeBound>& segment_polytope_bounds = std::vector<SegmentPolytopeBound>(),
+          const std::vector<NodeRangeBound>& node_range_bounds = std::vector<NodeRangeBound>(),
+          const std::vector<NodeValuesBound>& node_values_bounds = std::vector<NodeValuesBound>(),
+          const std::vector<SegmentRangeBound>& segment_range_bounds = std::vector<SegmentRangeBound>());
   
     private:
+      template <size_t Order, size_t Dims> friend class PolynomialSolverT;
+
+      // Shared back end of the runtime-sized and fixed-size front ends.
+      // Segment bound views must be allocated in the arena after it has been
+      // reset for this run. With predict_only, returns once the peak memory
+      // is predicted, without setting up OSQP.
+      Solution Solve(
+          const std::vector<double>& times,
+          const ProblemBounds& bounds,
+          const bool predict_only = false);
+
+      // Resets the arena and views the bounds of Run in it
+      ProblemBounds ViewBounds(
+          const std::vector<NodeEqualityBound>& node_equality_bounds,
+          const std::vector<NodeInequalityBound>& node_inequality_bounds,
+          const std::vector<SegmentInequalityBound>& segment_inequality_bounds,
+          const std::vector<SegmentBoxBound>& segment_box_bounds,
+          const std::vector<SegmentPolytopeBound>& segment_polytope_bounds,
+          const std::vector<NodeRangeBound>& node_range_bounds,
+          const std::vector<NodeValuesBound>& node_values_bounds,
+          const std::vector<SegmentRangeBound>& segment_range_bounds);
+
       Options options_;
+
+      // Owns every per-run buffer. Reset, not freed, between runs so that
+      // repeated solves do not allocate.
+      Arena arena_;
+
+      // Owns the buffers of a run that are only needed until the problem is
+      // handed to OSQP
+      Arena scratch_arena_;
+
+      // Assembly workers. Created on the first multi-threaded run.
+      std::shared_ptr<ThreadPool> thread_pool_;
   }; 
 }
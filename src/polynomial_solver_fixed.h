@@ -0,0 +1,119 @@
+// Author: Tucker Haydon
+
+#pragma once
+
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "polynomial_solver.h"
+#include "polynomial_bounds.h"
+#include "common.h"
+
+namespace p4 {
+  /* Fixed-size front end to PolynomialSolver for a compile-time polynomial
+   * order and number of dimensions.
+   *
+   * Segment bound mappings, per-segment coefficient blocks and evaluation use
+   * fixed-size Eigen types. Constructing bounds and reading back the solution
+   * do not allocate, and the per-segment kernels are unrolled by the
+   * compiler. The QP is assembled and solved by the same back end as
+   * PolynomialSolver.
+   *
+   * Example:
+   *   PolynomialSolverT<7,3>::Options options;
+   *   options.continuity_order = 4;
+   *   options.derivative_order = 4;
+   *   PolynomialSolverT<7,3> solver(options);
+   */
+  template <size_t Order, size_t Dims>
+  class PolynomialSolverT {
+    public:
+      static_assert(Order <= kMaxPolynomialOrder, "Polynomial order exceeds kMaxPolynomialOrder.");
+      static_assert(Dims > 0, "Number of dimensions must be greater than zero.");
+
+      // Coefficients of a single segment. Rows index the coefficients,
+      // columns index the dimensions.
+      typedef Eigen::Matrix<double, Order + 1, Dims> CoefficientMatrix;
+
+      // Options with the polynomial order and number of dimensions fixed
+      struct Options : public PolynomialSolver::Options {
+        Options() {
+          this->num_dimensions = Dims;
+          this->polynomial_order = Order;
+        }
+      };
+
+      struct Solution : public PolynomialSolver::Solution {
+        Solution() {}
+
+        Solution(const PolynomialSolver::Solution& solution)
+          : PolynomialSolver::Solution(solution) {}
+
+        // Returns the coefficients of every dimension for a specified
+        // segment index.
+        CoefficientMatrix SegmentCoefficients(const size_t node_idx) const {
+          CoefficientMatrix coefficients;
+          for(size_t dimension_idx = 0; dimension_idx < Dims; ++dimension_idx) {
+            for(size_t coefficient_idx = 0; coefficient_idx < Order + 1; ++coefficient_idx) {
+              coefficients(coefficient_idx, dimension_idx) 
+                = this->Coefficient(dimension_idx, node_idx, coefficient_idx);
+            }
+          }
+          return coefficients;
+        }
+      };
+
+      PolynomialSolverT(const Options& options = Options())
+        : solver_(options) {
+        if(Dims != options.num_dimensions || Order != options.polynomial_order) {
+          std::cerr << "PolynomialSolverT -- Options do not match the template parameters." << std::endl;
+          std::exit(EXIT_FAILURE);
+        }
+      }
+
+      Solution Run(
+          const std::vector<double>& times,
+          const std::vector<NodeEqualityBound>& node_equality_bounds,
+          const std::vector<NodeInequalityBound>& node_inequality_bounds,
+          const std::vector<SegmentInequalityBoundT<Dims>>& segment_inequality_bounds,
+          const std::vector<SegmentBoxBound>& segment_box_bounds = std::vector<SegmentBoxBound>(),
+          const std::vector<SegmentPolytopeBound>& segment_polytope_bounds = std::vector<SegmentPolytopeBound>(),
+          const std::vector<NodeRangeBound>& node_range_bounds = std::vector<NodeRangeBound>(),
+          const std::vector<NodeValuesBound>& node_values_bounds = std::vector<NodeValuesBound>(),
+          const std::vector<SegmentRangeBound>& segment_range_bounds = std::vector<SegmentRangeBound>()) {
+        // See PolynomialSolver::Run
+        Arena& arena = this->solver_.arena_;
+        arena.Reset();
+
+        SegmentBoundView* segment_bound_views 
+          = arena.template Allocate<SegmentBoundView>(segment_inequality_bounds.size());
+        for(size_t bound_idx = 0; bound_idx < segment_inequality_bounds.size(); ++bound_idx) {
+          const SegmentInequalityBoundT<Dims>& bound = segment_inequality_bounds[bound_idx];
+          segment_bound_views[bound_idx].segment_idx = bound.segment_idx;
+          segment_bound_views[bound_idx].derivative_idx = bound.derivative_idx;
+          segment_bound_views[bound_idx].mapping = bound.mapping.data();
+          segment_bound_views[bound_idx].mapping_size = Dims;
+          segment_bound_views[bound_idx].value = bound.value;
+        }
+
+        const ProblemBounds bounds = {
+          node_equality_bounds, 
+          node_inequality_bounds, 
+          segment_bound_views, 
+          segment_inequality_bounds.size(),
+          segment_box_bounds,
+          segment_polytope_bounds,
+          node_range_bounds,
+          node_values_bounds,
+          segment_range_bounds
+        };
+        return Solution(this->solver_.Solve(times, bounds));
+      }
+
+    private:
+      PolynomialSolver solver_;
+  };
+}
@@ -0,0 +1,343 @@
+// Author: Tucker Haydon
+
+#include <algorithm>
+#include <cmath>
+
+#include "presolve.h"
+
+namespace p4 {
+  namespace {
+    // Relative tolerance for deciding that an interval is a single point or
+    // that a bound is violated
+    constexpr double kTolerance = 1e-12;
+
+    // OSQP treats bounds at or beyond OSQP_INFTY as infinite
+    bool IsInfinite(const double bound) {
+      return std::abs(bound) >= OSQP_INFTY;
+    }
+
+    double Tolerance(
+        const double lower,
+        const double upper) {
+      double scale = 1.0;
+      if(false == IsInfinite(lower)) { scale = std::max(scale, std::abs(lower)); }
+      if(false == IsInfinite(upper)) { scale = std::max(scale, std::abs(upper)); }
+      return kTolerance * scale;
+    }
+
+    csc* AllocateCsc(
+        const c_int m,
+        const c_int n,
+        const c_int num_nz,
+        Arena& arena) {
+      csc* mat = arena.Allocate<csc>(1);
+      mat->m = m;
+      mat->n = n;
+      mat->nzmax = num_nz;
+      mat->nz = -1;
+      mat->p = arena.Allocate<c_int>(n + 1);
+      mat->i = arena.Allocate<c_int>(num_nz);
+      mat->x = arena.Allocate<c_float>(num_nz);
+      return mat;
+    }
+  }
+
+  bool Presolver::Run(
+      const OSQPData& data,
+      Arena& arena) {
+    const csc* A = data.A;
+    const csc* P = data.P;
+    const c_int m = data.m;
+    const c_int n = data.n;
+    this->n_ = n;
+    this->objective_offset_ = 0;
+
+    // Row-wise copy of A, used to find the remaining entry of a singleton row
+    c_int* row_ptrs = arena.Allocate<c_int>(m + 1);
+    std::fill(row_ptrs, row_ptrs + m + 1, 0);
+    for(c_int nz_idx = 0; nz_idx < A->p[n]; ++nz_idx) {
+      row_ptrs[A->i[nz_idx] + 1]++;
+    }
+    for(c_int row = 0; row < m; ++row) {
+      row_ptrs[row + 1] += row_ptrs[row];
+    }
+    c_int* row_cols = arena.Allocate<c_int>(A->p[n]);
+    c_float* row_values = arena.Allocate<c_float>(A->p[n]);
+    c_int* cursor = arena.Allocate<c_int>(m);
+    std::copy(row_ptrs, row_ptrs + m, cursor);
+    for(c_int col = 0; col < n; ++col) {
+      for(c_int nz_idx = A->p[col]; nz_idx < A->p[col + 1]; ++nz_idx) {
+        const c_int pos = cursor[A->i[nz_idx]]++;
+        row_cols[pos] = col;
+        row_values[pos] = A->x[nz_idx];
+      }
+    }
+
+    this->lower_ = arena.Allocate<c_float>(m);
+    this->upper_ = arena.Allocate<c_float>(m);
+    std::copy(data.l, data.l + m, this->lower_);
+    std::copy(data.u, data.u + m, this->upper_);
+
+    this->row_counts_ = arena.Allocate<c_int>(m);
+    this->row_dropped_ = arena.Allocate<uint8_t>(m);
+    std::fill(this->row_dropped_, this->row_dropped_ + m, 0);
+
+    // A row's count only decreases, so it becomes a singleton at most once
+    this->worklist_ = arena.Allocate<c_int>(m);
+    this->worklist_size_ = 0;
+
+    double* col_lower = arena.Allocate<double>(n);
+    double* col_upper = arena.Allocate<double>(n);
+    std::fill(col_lower, col_lower + n, -OSQP_INFTY);
+    std::fill(col_upper, col_upper + n, OSQP_INFTY);
+
+    this->col_map_ = arena.Allocate<c_int>(n);
+    this->fixed_values_ = arena.Allocate<double>(n);
+    std::fill(this->col_map_, this->col_map_ + n, 0);
+
+    for(c_int row = 0; row < m; ++row) {
+      this->row_counts_[row] = row_ptrs[row + 1] - row_ptrs[row];
+      if(1 == this->row_counts_[row]) {
+        this->worklist_[this->worklist_size_++] = row;
+      } else if(0 == this->row_counts_[row] && false == this->DropEmptyRow(row)) {
+        return false;
+      }
+    }
+
+    // Fold singleton rows into variable intervals
+    c_int num_folded_rows = 0;
+    while(this->worklist_size_ > 0) {
+      const c_int row = this->worklist_[--this->worklist_size_];
+      if(1 == this->row_dropped_[row]) {
+        continue;
+      }
+
+      // The only entry not belonging to a fixed variable
+      c_int col = -1;
+      double value = 0;
+      for(c_int pos = row_ptrs[row]; pos < row_ptrs[row + 1]; ++pos) {
+        if(-1 != this->col_map_[row_cols[pos]]) {
+          col = row_cols[pos];
+          value = row_values[pos];
+          break;
+        }
+      }
+
+      double lower = -OSQP_INFTY;
+      double upper = OSQP_INFTY;
+      if(value > 0) {
+        if(false == IsInfinite(this->lower_[row])) { lower = this->lower_[row] / value; }
+        if(false == IsInfinite(this->upper_[row])) { upper = this->upper_[row] / value; }
+      } else {
+        if(false == IsInfinite(this->upper_[row])) { lower = this->upper_[row] / value; }
+        if(false == IsInfinite(this->lower_[row])) { upper = this->lower_[row] / value; }
+      }
+
+      col_lower[col] = std::max(col_lower[col], lower);
+      col_upper[col] = std::min(col_upper[col], upper);
+      this->row_dropped_[row] = 1;
+      num_folded_rows++;
+
+      const double tolerance = Tolerance(col_lower[col], col_upper[col]);
+      if(col_lower[col] > col_upper[col] + tolerance) {
+        return false;
+      }
+      if(col_upper[col] - col_lower[col] <= tolerance) {
+        if(false == this->Fix(A, col, 0.5 * (col_lower[col] + col_upper[col]))) {
+          return false;
+        }
+      }
+    }
+
+    if(0 == num_folded_rows) {
+      return false;
+    }
+
+    // Reduced variable indices
+    c_int num_free_cols = 0;
+    for(c_int col = 0; col < n; ++col) {
+      if(-1 != this->col_map_[col]) {
+        this->col_map_[col] = num_free_cols++;
+      }
+    }
+    if(0 == num_free_cols) {
+      return false;
+    }
+
+    // Reduced row indices. Rows without bounds are always satisfied. Bound
+    // rows of free variables follow the kept rows.
+    c_int* row_map = arena.Allocate<c_int>(m);
+    c_int num_kept_rows = 0;
+    for(c_int row = 0; row < m; ++row) {
+      const bool is_free = IsInfinite(this->lower_[row]) && IsInfinite(this->upper_[row]);
+      row_map[row] = (1 == this->row_dropped_[row] || true == is_free) ? -1 : num_kept_rows++;
+    }
+
+    c_int num_reduced_rows = num_kept_rows;
+    c_int num_reduced_nz = 0;
+    for(c_int col = 0; col < n; ++col) {
+      if(-1 == this->col_map_[col]) {
+        continue;
+      }
+      for(c_int nz_idx = A->p[col]; nz_idx < A->p[col + 1]; ++nz_idx) {
+        if(-1 != row_map[A->i[nz_idx]]) {
+          num_reduced_nz++;
+        }
+      }
+      if(false == IsInfinite(col_lower[col]) || false == IsInfinite(col_upper[col])) {
+        num_reduced_rows++;
+        num_reduced_nz++;
+      }
+    }
+
+    // Reduced constraints. Rows keep their relative order, so row indices
+    // within each column stay sorted.
+    csc* reduced_A = AllocateCsc(num_reduced_rows, num_free_cols, num_reduced_nz, arena);
+    c_float* reduced_l = arena.Allocate<c_float>(num_reduced_rows);
+    c_float* reduced_u = arena.Allocate<c_float>(num_reduced_rows);
+    for(c_int row = 0; row < m; ++row) {
+      if(-1 != row_map[row]) {
+        reduced_l[row_map[row]] = this->lower_[row];
+        reduced_u[row_map[row]] = this->upper_[row];
+      }
+    }
+
+    c_int nz_idx = 0;
+    c_int bound_row = num_kept_rows;
+    for(c_int col = 0; col < n; ++col) {
+      if(-1 == this->col_map_[col]) {
+        continue;
+      }
+      reduced_A->p[this->col_map_[col]] = nz_idx;
+      for(c_int src_idx = A->p[col]; src_idx < A->p[col + 1]; ++src_idx) {
+        if(-1 != row_map[A->i[src_idx]]) {
+          reduced_A->i[nz_idx] = row_map[A->i[src_idx]];
+          reduced_A->x[nz_idx] = A->x[src_idx];
+          nz_idx++;
+        }
+      }
+      if(false == IsInfinite(col_lower[col]) || false == IsInfinite(col_upper[col])) {
+        reduced_A->i[nz_idx] = bound_row;
+        reduced_A->x[nz_idx] = 1;
+        reduced_l[bound_row] = col_lower[col];
+        reduced_u[bound_row] = col_upper[col];
+        nz_idx++;
+        bound_row++;
+      }
+    }
+    reduced_A->p[num_free_cols] = nz_idx;
+
+    // Reduced cost. P holds the upper triangle. Entries coupling a free and
+    // a fixed variable move into the linear cost; entries between fixed
+    // variables are constant.
+    c_float* reduced_q = arena.Allocate<c_float>(num_free_cols);
+    for(c_int col = 0; col < n; ++col) {
+      if(-1 != this->col_map_[col]) {
+        reduced_q[this->col_map_[col]] = data.q[col];
+      } else {
+        this->objective_offset_ += data.q[col] * this->fixed_values_[col];
+      }
+    }
+
+    c_int num_reduced_P_nz = 0;
+    for(c_int col = 0; col < n; ++col) {
+      for(c_int src_idx = P->p[col]; src_idx < P->p[col + 1]; ++src_idx) {
+        const c_int row = P->i[src_idx];
+        const bool row_free = -1 != this->col_map_[row];
+        const bool col_free = -1 != this->col_map_[col];
+        if(true == row_free && true == col_free) {
+          num_reduced_P_nz++;
+        } else if(true == row_free) {
+          reduced_q[this->col_map_[row]] += P->x[src_idx] * this->fixed_values_[col];
+        } else if(true == col_free) {
+          reduced_q[this->col_map_[col]] += P->x[src_idx] * this->fixed_values_[row];
+        } else {
+          const double weight = row == col ? 0.5 : 1.0;
+          this->objective_offset_
+            += weight * P->x[src_idx] * this->fixed_values_[row] * this->fixed_values_[col];
+        }
+      }
+    }
+
+    csc* reduced_P = AllocateCsc(num_free_cols, num_free_cols, num_reduced_P_nz, arena);
+    nz_idx = 0;
+    for(c_int col = 0; col < n; ++col) {
+      if(-1 == this->col_map_[col]) {
+        continue;
+      }
+      reduced_P->p[this->col_map_[col]] = nz_idx;
+      for(c_int src_idx = P->p[col]; src_idx < P->p[col + 1]; ++src_idx) {
+        if(-1 != this->col_map_[P->i[src_idx]]) {
+          reduced_P->i[nz_idx] = this->col_map_[P->i[src_idx]];
+          reduced_P->x[nz_idx] = P->x[src_idx];
+          nz_idx++;
+        }
+      }
+    }
+    reduced_P->p[num_free_cols] = nz_idx;
+
+    this->reduced_data_ = arena.Allocate<OSQPData>(1);
+    this->reduced_data_->n = num_free_cols;
+    this->reduced_data_->m = num_reduced_rows;
+    this->reduced_data_->P = reduced_P;
+    this->reduced_data_->q = reduced_q;
+    this->reduced_data_->A = reduced_A;
+    this->reduced_data_->l = reduced_l;
+    this->reduced_data_->u = reduced_u;
+
+    return true;
+  }
+
+  bool Presolver::Fix(
+      const csc* A,
+      const c_int col,
+      const double value) {
+    this->col_map_[col] = -1;
+    this->fixed_values_[col] = value;
+
+    for(c_int nz_idx = A->p[col]; nz_idx < A->p[col + 1]; ++nz_idx) {
+      const c_int row = A->i[nz_idx];
+      if(1 == this->row_dropped_[row]) {
+        continue;
+      }
+
+      const double shift = A->x[nz_idx] * value;
+      if(false == IsInfinite(this->lower_[row])) { this->lower_[row] -= shift; }
+      if(false == IsInfinite(this->upper_[row])) { this->upper_[row] -= shift; }
+
+      this->row_counts_[row]--;
+      if(1 == this->row_counts_[row]) {
+        this->worklist_[this->worklist_size_++] = row;
+      } else if(0 == this->row_counts_[row] && false == this->DropEmptyRow(row)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool Presolver::DropEmptyRow(const c_int row) {
+    const double tolerance = Tolerance(this->lower_[row], this->upper_[row]);
+    this->row_dropped_[row] = 1;
+    return this->lower_[row] <= tolerance && this->upper_[row] >= -tolerance;
+  }
+
+  void Presolver::Restore(
+      const c_float* reduced_x,
+      double* x) const {
+    for(c_int col = 0; col < this->n_; ++col) {
+      x[col] = -1 == this->col_map_[col]
+        ? this->fixed_values_[col]
+        : reduced_x[this->col_map_[col]];
+    }
+  }
+
+  void Presolver::Reduce(
+      const double* x,
+      c_float* reduced_x) const {
+    for(c_int col = 0; col < this->n_; ++col) {
+      if(-1 != this->col_map_[col]) {
+        reduced_x[this->col_map_[col]] = x[col];
+      }
+    }
+  }
+}
@@ -0,0 +1,93 @@
+// Author: Tucker Haydon
+
+#pragma once
+
+#include <cstdint>
+
+#include <osqp.h>
+
+#include "arena.h"
+
+namespace p4 {
+  /* Presolve pass for the QPs assembled by PolynomialSolver.
+   *
+   * Every node bound is a singleton row of A, and several node bounds on the
+   * same coefficient are several rows. The presolver:
+   *   1) folds singleton rows into an interval on their variable, merging
+   *      duplicate and overlapping bounds,
+   *   2) fixes variables whose interval is a single point and substitutes
+   *      them out of the remaining rows and the cost. Rows that become
+   *      singletons are folded in turn,
+   *   3) drops rows that are always satisfied.
+   * Every remaining variable with a finite interval gets a single bound row.
+   * The reduced solution is mapped back to the full state vector with
+   * Restore.
+   *
+   * The reduced problem and the bookkeeping live in the arena passed to Run.
+   */
+  class Presolver {
+    public:
+      Presolver() {}
+
+      // Reduces a problem. Returns false if there is nothing to reduce, if
+      // every variable is fixed, or if presolve finds the problem to be
+      // inconsistent. The original problem should then be solved as-is so
+      // that OSQP reports the status.
+      bool Run(
+          const OSQPData& data,
+          Arena& arena);
+
+      // Reduced problem. Valid after Run returns true.
+      OSQPData* ReducedData() const {
+        return this->reduced_data_;
+      }
+
+      // Writes the full state vector given the solution of the reduced
+      // problem
+      void Restore(
+          const c_float* reduced_x,
+          double* x) const;
+
+      // Writes the reduced state vector given a full state vector. The
+      // inverse of Restore for the free variables; used to warm start the
+      // reduced problem.
+      void Reduce(
+          const double* x,
+          c_float* reduced_x) const;
+
+      // Cost of the fixed variables, which is constant and therefore not part
+      // of the reduced problem
+      double ObjectiveOffset() const {
+        return this->objective_offset_;
+      }
+
+    private:
+      // Fixes a variable and substitutes it out of every active row. Returns
+      // false if a row that loses its last entry is violated.
+      bool Fix(
+          const csc* A,
+          const c_int col,
+          const double value);
+
+      // Drops a row without entries. Returns false if it is violated.
+      bool DropEmptyRow(const c_int row);
+
+      // Number of variables of the full problem
+      c_int n_ = 0;
+
+      // Reduced index of every variable, -1 if fixed
+      c_int* col_map_ = nullptr;
+      double* fixed_values_ = nullptr;
+      double objective_offset_ = 0;
+
+      OSQPData* reduced_data_ = nullptr;
+
+      // Working state of Run
+      c_float* lower_ = nullptr;
+      c_float* upper_ = nullptr;
+      c_int* row_counts_ = nullptr;
+      uint8_t* row_dropped_ = nullptr;
+      c_int* worklist_ = nullptr;
+      c_int worklist_size_ = 0;
+  };
+}
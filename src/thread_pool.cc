@@ -0,0 +1,90 @@
+// Author: Tucker Haydon
+
+#include "thread_pool.h"
+
+namespace p4 {
+  ThreadPool::ThreadPool(const size_t num_threads)
+    : next_task_idx_(0) {
+    for(size_t thread_idx = 1; thread_idx < num_threads; ++thread_idx) {
+      this->workers_.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+  }
+
+  ThreadPool::~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->stop_ = true;
+    }
+    this->work_available_.notify_all();
+    for(std::thread& worker: this->workers_) {
+      worker.join();
+    }
+  }
+
+  void ThreadPool::Run(
+      const size_t num_tasks, 
+      const std::function<void(size_t)>& task) {
+    std::lock_guard<std::mutex> run_lock(this->run_mutex_);
+
+    // Not worth waking the workers
+    if(num_tasks < 2 || true == this->workers_.empty()) {
+      for(size_t task_idx = 0; task_idx < num_tasks; ++task_idx) {
+        task(task_idx);
+      }
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->task_ = &task;
+      this->num_tasks_ = num_tasks;
+      this->next_task_idx_ = 0;
+      this->num_busy_workers_ = this->workers_.size();
+      this->generation_++;
+    }
+    this->work_available_.notify_all();
+
+    // The calling thread works too
+    this->ClaimTasks();
+
+    std::unique_lock<std::mutex> lock(this->mutex_);
+    this->work_done_.wait(lock, [this]() { return 0 == this->num_busy_workers_; });
+    this->task_ = nullptr;
+  }
+
+  void ThreadPool::ClaimTasks() {
+    while(true) {
+      const size_t task_idx = this->next_task_idx_++;
+      if(task_idx >= this->num_tasks_) {
+        break;
+      }
+      (*this->task_)(task_idx);
+    }
+  }
+
+  void ThreadPool::WorkerLoop() {
+    size_t generation = 0;
+    while(true) {
+      {
+        std::unique_lock<std::mutex> lock(this->mutex_);
+        this->work_available_.wait(lock, [this, generation]() { 
+            return true == this->stop_ || generation != this->generation_; 
+        });
+        if(true == this->stop_) {
+          return;
+        }
+        generation = this->generation_;
+      }
+
+      this->ClaimTasks();
+
+      {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        this->num_busy_workers_--;
+        if(0 == this->num_busy_workers_) {
+          this->work_done_.notify_one();
+        }
+      }
+    }
+  }
+}
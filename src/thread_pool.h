@@ -0,0 +1,63 @@
+// Author: Tucker Haydon
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace p4 {
+  // Fixed-size pool of worker threads. ParallelFor distributes a range of
+  // task indices over the workers and the calling thread and returns once
+  // every task has finished. Tasks are claimed dynamically, so the order in
+  // which they run is unspecified: tasks must write to disjoint memory.
+  // Concurrent calls to ParallelFor are serialized.
+  class ThreadPool {
+    public:
+      // num_threads includes the calling thread
+      ThreadPool(const size_t num_threads);
+      ~ThreadPool();
+
+      ThreadPool(const ThreadPool&) = delete;
+      ThreadPool& operator=(const ThreadPool&) = delete;
+
+      // Runs task(task_idx) for every task_idx in [0, num_tasks)
+      template <class Task>
+      void ParallelFor(const size_t num_tasks, const Task& task) {
+        // Capturing a single reference keeps std::function from allocating
+        const std::function<void(size_t)> function 
+          = [&task](const size_t task_idx) { task(task_idx); };
+        this->Run(num_tasks, function);
+      }
+
+      size_t NumThreads() const {
+        return this->workers_.size() + 1;
+      }
+
+    private:
+      void Run(const size_t num_tasks, const std::function<void(size_t)>& task);
+      void WorkerLoop();
+      void ClaimTasks();
+
+      std::vector<std::thread> workers_;
+
+      // Serializes calls to Run
+      std::mutex run_mutex_;
+
+      // Guards the members below
+      std::mutex mutex_;
+      std::condition_variable work_available_;
+      std::condition_variable work_done_;
+      const std::function<void(size_t)>* task_ = nullptr;
+      size_t num_tasks_ = 0;
+      size_t num_busy_workers_ = 0;
+      size_t generation_ = 0;
+      bool stop_ = false;
+
+      std::atomic<size_t> next_task_idx_;
+  };
+}
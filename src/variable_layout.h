@@ -0,0 +1,143 @@
+// Author: Tucker Haydon
+
+#pragma once
+
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+namespace p4 {
+  // Order in which the polynomial coefficients are stacked in the QP state
+  // vector. Coefficients of a single polynomial are always contiguous.
+  enum class VariableOrdering {
+    // Ordered by coefficient, then segment, then dimension. Every polynomial
+    // of a dimension is contiguous.
+    DIMENSION_MAJOR,
+    // Ordered by coefficient, then dimension, then segment. Every polynomial
+    // of a segment is contiguous, so constraints that couple dimensions
+    // touch neighbouring columns.
+    SEGMENT_MAJOR
+  };
+
+  // Maps (dimension, segment, coefficient) to an index into the QP state
+  // vector. The polynomial of a dimension and segment is a block of
+  // consecutive coefficients; blocks are numbered in state vector order.
+  // Blocks either all hold the same number of coefficients or each hold
+  // their own, when segments or dimensions have different polynomial orders.
+  // Assembly and solution extraction go through this class only.
+  class VariableLayout {
+    public:
+      VariableLayout() {}
+
+      VariableLayout(
+          const VariableOrdering ordering,
+          const size_t num_dimensions,
+          const size_t num_segments,
+          const size_t num_coefficients)
+        : ordering_(ordering),
+          num_dimensions_(num_dimensions),
+          num_segments_(num_segments),
+          num_coefficients_(num_coefficients) {}
+
+      // Layout with a number of coefficients per polynomial, indexed by
+      // dimension_idx * num_segments + segment_idx
+      VariableLayout(
+          const VariableOrdering ordering,
+          const size_t num_dimensions,
+          const size_t num_segments,
+          const std::vector<size_t>& num_coefficients)
+        : ordering_(ordering),
+          num_dimensions_(num_dimensions),
+          num_segments_(num_segments) {
+          std::shared_ptr<std::vector<size_t>> block_offsets 
+            = std::make_shared<std::vector<size_t>>(this->NumBlocks() + 1);
+          (*block_offsets)[0] = 0;
+          for(size_t block_idx = 0; block_idx < this->NumBlocks(); ++block_idx) {
+            (*block_offsets)[block_idx + 1] = (*block_offsets)[block_idx] 
+              + num_coefficients[this->BlockDimension(block_idx) * num_segments + this->BlockSegment(block_idx)];
+          }
+          block_offsets_ = block_offsets;
+        }
+
+      // Block of the polynomial of a dimension and segment
+      size_t Block(
+          const size_t dimension_idx,
+          const size_t segment_idx) const {
+        return VariableOrdering::DIMENSION_MAJOR == ordering_
+          ? dimension_idx * num_segments_ + segment_idx
+          : segment_idx * num_dimensions_ + dimension_idx;
+      }
+
+      // Dimension of the polynomial of a block
+      size_t BlockDimension(const size_t block_idx) const {
+        return VariableOrdering::DIMENSION_MAJOR == ordering_
+          ? block_idx / num_segments_
+          : block_idx % num_dimensions_;
+      }
+
+      // Segment of the polynomial of a block
+      size_t BlockSegment(const size_t block_idx) const {
+        return VariableOrdering::DIMENSION_MAJOR == ordering_
+          ? block_idx % num_segments_
+          : block_idx / num_dimensions_;
+      }
+
+      // State vector index of a coefficient
+      size_t Index(
+          const size_t dimension_idx,
+          const size_t segment_idx,
+          const size_t coefficient_idx) const {
+        return this->BlockOffset(this->Block(dimension_idx, segment_idx)) + coefficient_idx;
+      }
+
+      // State vector index of the first coefficient of a block
+      size_t BlockOffset(const size_t block_idx) const {
+        return nullptr == block_offsets_
+          ? block_idx * num_coefficients_
+          : (*block_offsets_)[block_idx];
+      }
+
+      // Number of coefficients of the polynomial of a block
+      size_t BlockSize(const size_t block_idx) const {
+        return nullptr == block_offsets_
+          ? num_coefficients_
+          : (*block_offsets_)[block_idx + 1] - (*block_offsets_)[block_idx];
+      }
+
+      // Number of coefficients of the polynomial of a dimension and segment
+      size_t NumCoefficients(
+          const size_t dimension_idx,
+          const size_t segment_idx) const {
+        return this->BlockSize(this->Block(dimension_idx, segment_idx));
+      }
+
+      // Whether every block holds the same number of coefficients
+      bool IsUniform() const {
+        return nullptr == block_offsets_;
+      }
+
+      size_t NumBlocks() const {
+        return num_dimensions_ * num_segments_;
+      }
+
+      // Length of the state vector
+      size_t Size() const {
+        return this->BlockOffset(this->NumBlocks());
+      }
+
+      VariableOrdering Ordering() const {
+        return ordering_;
+      }
+
+    private:
+      VariableOrdering ordering_ = VariableOrdering::DIMENSION_MAJOR;
+      size_t num_dimensions_ = 0;
+      size_t num_segments_ = 0;
+      size_t num_coefficients_ = 0;
+
+      // First state vector index of every block, followed by the length of
+      // the state vector. Null when every block has num_coefficients_
+      // coefficients. Shared, as layouts are copied into every solution.
+      std::shared_ptr<const std::vector<size_t>> block_offsets_;
+  };
+}
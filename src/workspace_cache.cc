@@ -0,0 +1,149 @@
+// Author: Tucker Haydon
+
+#include <algorithm>
+#include <vector>
+
+#include "workspace_cache.h"
+
+namespace p4 {
+  namespace {
+    bool SamePattern(
+        const csc* mat,
+        const csc* other) {
+      return
+        mat->m == other->m &&
+        mat->n == other->n &&
+        std::equal(mat->p, mat->p + mat->n + 1, other->p) &&
+        std::equal(mat->i, mat->i + mat->p[mat->n], other->i);
+    }
+
+    // Whether a workspace set up with settings solves like one set up with
+    // other. Compared field by field; the structure may be padded.
+    bool SameSettings(
+        const OSQPSettings& settings,
+        const OSQPSettings& other) {
+      return
+        settings.rho == other.rho &&
+        settings.sigma == other.sigma &&
+        settings.scaling == other.scaling &&
+        settings.adaptive_rho == other.adaptive_rho &&
+        settings.adaptive_rho_interval == other.adaptive_rho_interval &&
+        settings.adaptive_rho_tolerance == other.adaptive_rho_tolerance &&
+        settings.max_iter == other.max_iter &&
+        settings.eps_abs == other.eps_abs &&
+        settings.eps_rel == other.eps_rel &&
+        settings.eps_prim_inf == other.eps_prim_inf &&
+        settings.eps_dual_inf == other.eps_dual_inf &&
+        settings.alpha == other.alpha &&
+        settings.linsys_solver == other.linsys_solver &&
+        settings.delta == other.delta &&
+        settings.polish == other.polish &&
+        settings.polish_refine_iter == other.polish_refine_iter &&
+        settings.verbose == other.verbose &&
+        settings.scaled_termination == other.scaled_termination &&
+        settings.check_termination == other.check_termination &&
+        settings.warm_start == other.warm_start;
+    }
+  }
+
+  std::shared_ptr<WorkspaceCache> WorkspaceCache::Instance() {
+    static const std::shared_ptr<WorkspaceCache> instance = std::make_shared<WorkspaceCache>();
+    return instance;
+  }
+
+  WorkspaceCache::~WorkspaceCache() {
+    for(const Entry& entry: this->entries_) {
+      osqp_cleanup(entry.workspace);
+    }
+  }
+
+  void WorkspaceCache::SetCapacity(const size_t capacity) {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->capacity_ = capacity;
+    this->Evict();
+  }
+
+  std::shared_ptr<OSQPWorkspace> WorkspaceCache::Acquire(
+      const uint64_t key,
+      OSQPData* data,
+      OSQPSettings* settings) {
+    Entry entry;
+    entry.key = key;
+    entry.settings = *settings;
+    entry.workspace = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      for(std::list<Entry>::iterator it = this->entries_.begin(); it != this->entries_.end(); ++it) {
+        const OSQPData* cached_data = it->workspace->data;
+        if(key == it->key
+            && true == SameSettings(*settings, it->settings)
+            && data->n == cached_data->n
+            && data->m == cached_data->m
+            && true == SamePattern(data->P, cached_data->P)
+            && true == SamePattern(data->A, cached_data->A)) {
+          entry.workspace = it->workspace;
+          this->entries_.erase(it);
+          break;
+        }
+      }
+    }
+
+    if(nullptr == entry.workspace) {
+      entry.workspace = osqp_setup(data, settings);
+      // Invalid problems are not cached
+      if(nullptr == entry.workspace) {
+        return std::shared_ptr<OSQPWorkspace>(
+            entry.workspace,
+            [](OSQPWorkspace* workspace) {
+              osqp_cleanup(workspace);
+            });
+      }
+    } else {
+      // Numeric updates only. The rho a previous solve may have adapted is
+      // restored and the iterates are reset.
+      OSQPWorkspace* workspace = entry.workspace;
+      osqp_update_P_A(
+          workspace,
+          data->P->x, nullptr, data->P->p[data->P->n],
+          data->A->x, nullptr, data->A->p[data->A->n]);
+      osqp_update_lin_cost(workspace, data->q);
+      osqp_update_bounds(workspace, data->l, data->u);
+      osqp_update_rho(workspace, settings->rho);
+      const std::vector<c_float> zeros(std::max(data->n, data->m), 0);
+      osqp_warm_start(workspace, zeros.data(), zeros.data());
+    }
+
+    // The workspace is cleaned up if the cache is gone by the time it is
+    // released
+    const std::weak_ptr<WorkspaceCache> cache = this->shared_from_this();
+    return std::shared_ptr<OSQPWorkspace>(
+        entry.workspace,
+        [cache, entry](OSQPWorkspace* workspace) {
+          const std::shared_ptr<WorkspaceCache> locked_cache = cache.lock();
+          if(nullptr == locked_cache) {
+            osqp_cleanup(workspace);
+          } else {
+            locked_cache->Release(entry);
+          }
+        });
+  }
+
+  size_t WorkspaceCache::Size() {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    return this->entries_.size();
+  }
+
+  void WorkspaceCache::Release(
+      const Entry& entry) {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->entries_.push_front(entry);
+    this->Evict();
+  }
+
+  void WorkspaceCache::Evict() {
+    while(this->entries_.size() > this->capacity_) {
+      osqp_cleanup(this->entries_.back().workspace);
+      this->entries_.pop_back();
+    }
+  }
+}
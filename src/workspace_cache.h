@@ -0,0 +1,96 @@
+// Author: Tucker Haydon
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <list>
+#include <memory>
+#include <mutex>
+
+#include <osqp.h>
+
+namespace p4 {
+  // FNV-1a hash of a sequence of integers and floating point numbers. Used
+  // to fingerprint the structure of a problem.
+  class StructureHash {
+    public:
+      void Add(const uint64_t value) {
+        for(size_t byte_idx = 0; byte_idx < sizeof(value); ++byte_idx) {
+          this->value_ ^= (value >> (8 * byte_idx)) & 0xff;
+          this->value_ *= 0x100000001b3ull;
+        }
+      }
+
+      uint64_t Value() const {
+        return this->value_;
+      }
+
+    private:
+      uint64_t value_ = 0xcbf29ce484222325ull;
+  };
+
+  /* Bounded, process-wide cache of OSQP workspaces, keyed on a structural
+   * fingerprint of the problem they were set up for.
+   *
+   * A workspace handed out by Acquire is owned by the caller until its
+   * shared pointer is released, at which point it returns to the cache. A
+   * problem whose fingerprint, settings, dimensions and sparsity patterns
+   * match a cached workspace is handed to it with osqp_update_P_A,
+   * osqp_update_lin_cost and osqp_update_bounds, which keep the KKT ordering
+   * and symbolic factorization. The fingerprint only selects candidates; the
+   * patterns are always compared. When the cache is full, the least recently
+   * released workspace is cleaned up.
+   *
+   * Thread-safe. A workspace is used by a single run at a time. Must be
+   * owned by a shared pointer.
+   */
+  class WorkspaceCache : public std::enable_shared_from_this<WorkspaceCache> {
+    public:
+      // Cache shared by every solver of the process
+      static std::shared_ptr<WorkspaceCache> Instance();
+
+      WorkspaceCache() {}
+      ~WorkspaceCache();
+
+      WorkspaceCache(const WorkspaceCache&) = delete;
+      WorkspaceCache& operator=(const WorkspaceCache&) = delete;
+
+      // Maximum number of idle workspaces. Shrinking the cache cleans up the
+      // least recently released workspaces. 0 disables caching.
+      void SetCapacity(const size_t capacity);
+
+      // Returns a workspace holding the problem. Sets up OSQP if no cached
+      // workspace matches. A reused workspace starts from a zero primal and
+      // dual solution, like a new one.
+      std::shared_ptr<OSQPWorkspace> Acquire(
+          const uint64_t key,
+          OSQPData* data,
+          OSQPSettings* settings);
+
+      // Number of idle workspaces
+      size_t Size();
+
+    private:
+      struct Entry {
+        uint64_t key;
+        // Settings the workspace was set up with. OSQP adapts some of the
+        // settings held by the workspace.
+        OSQPSettings settings;
+        OSQPWorkspace* workspace;
+      };
+
+      // Returns a workspace to the cache
+      void Release(
+          const Entry& entry);
+
+      // Cleans up the least recently released workspaces beyond the
+      // capacity. The mutex must be held.
+      void Evict();
+
+      std::mutex mutex_;
+      size_t capacity_ = 16;
+      // Most recently released first
+      std::list<Entry> entries_;
+  };
+}